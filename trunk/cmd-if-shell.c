@@ -111,6 +111,7 @@ cmd_if_shell_free(void *data)
 		ctx->cmdclient->references--;
 		exitdata.retcode = ctx->cmdclient->retcode;
 		ctx->cmdclient->flags |= CLIENT_EXIT;
+		server_client_dirty(ctx->cmdclient);
 	}
 	if (ctx->curclient != NULL)
 		ctx->curclient->references--;
@@ -85,6 +85,9 @@ cmd_list_exec(struct cmd_list *cmdlist, struct cmd_ctx *ctx)
 	struct cmd	*cmd;
 	int		 n, retval, guards;
 
+	/* Commands can change what any client is showing. */
+	server_client_dirty_all();
+
 	guards = 0;
 	if (c != NULL && c->session != NULL)
 		guards = c->flags & CLIENT_CONTROL;
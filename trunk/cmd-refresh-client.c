@@ -48,8 +48,11 @@ cmd_refresh_client_exec(struct cmd *self, struct cmd_ctx *ctx)
 	if (args_has(args, 'S')) {
 		status_update_jobs(c);
 		server_status_client(c);
-	} else
+	} else {
+		/* Redraw everything in case the terminal has been garbled. */
+		tty_invalidate(&c->tty);
 		server_redraw_client(c);
+	}
 
 	return (0);
 }
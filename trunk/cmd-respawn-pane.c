@@ -83,7 +83,7 @@ cmd_respawn_pane_exec(struct cmd *self, struct cmd_ctx *ctx)
 		environ_free(&env);
 		return (-1);
 	}
-	wp->flags |= PANE_REDRAW;
+	server_redraw_pane(wp);
 	server_status_window(w);
 
 	environ_free(&env);
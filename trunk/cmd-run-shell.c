@@ -132,6 +132,7 @@ cmd_run_shell_free(void *data)
 	if (ctx->cmdclient != NULL) {
 		ctx->cmdclient->references--;
 		ctx->cmdclient->flags |= CLIENT_EXIT;
+		server_client_dirty(ctx->cmdclient);
 	}
 	if (ctx->curclient != NULL)
 		ctx->curclient->references--;
@@ -62,8 +62,8 @@ cmd_server_info_exec(unused struct cmd *self, struct cmd_ctx *ctx)
 	char					 out[80];
 	char					*tim;
 	time_t		 			 t;
-	u_int					 lines, ulines;
-	size_t					 size, usize;
+	u_int					 lines, clines;
+	size_t					 size, csize;
 
 	tim = ctime(&start_time);
 	*strchr(tim, '\n') = '\0';
@@ -75,6 +75,14 @@ cmd_server_info_exec(unused struct cmd *self, struct cmd_ctx *ctx)
 		ctx->print(ctx, "system is %s %s %s %s",
 		    un.sysname, un.release, un.version, un.machine);
 	}
+	ctx->print(ctx, "grid memory %zu bytes, limit %lld kilobytes",
+	    grid_memory,
+	    options_get_number(&global_options, "history-memory-limit"));
+	ctx->print(ctx, "UTF-8 table %u entries, %zu bytes each",
+	    grid_utf8_entries(), sizeof (struct grid_utf8));
+	ctx->print(ctx, "tty writes %lu, clients visited %lu",
+	    tty_writes, tty_write_clients);
+	ctx->print(ctx, "loop passes %u per second", server_loop_rate);
 	if (cfg_file != NULL)
 		ctx->print(ctx, "configuration file is %s", cfg_file);
 	else
@@ -115,26 +123,33 @@ cmd_server_info_exec(unused struct cmd *self, struct cmd_ctx *ctx)
 			    w->lastlayout);
 			j = 0;
 			TAILQ_FOREACH(wp, &w->panes, entry) {
-				lines = ulines = size = usize = 0;
+				lines = clines = 0;
+				size = csize = 0;
 				gd = wp->base.grid;
-				for (k = 0; k < gd->hsize + gd->sy; k++) {
-					gl = &gd->linedata[k];
+				for (k = gd->coldsize; k < gd->hsize + gd->sy;
+				    k++) {
+					gl = grid_get_line(gd, k);
 					if (gl->celldata != NULL) {
 						lines++;
 						size += gl->cellsize *
 						    sizeof *gl->celldata;
 					}
-					if (gl->utf8data != NULL) {
-						ulines++;
-						usize += gl->utf8size *
-						    sizeof *gl->utf8data;
+					if (gl->compactdata != NULL) {
+						clines++;
+						csize += grid_line_memory(gl);
 					}
 				}
 				ctx->print(ctx, "%6u: %s %lu %d %u/%u, %zu "
-				    "bytes; UTF-8 %u/%u, %zu bytes", j,
+				    "bytes; compact %u/%u, %zu bytes", j,
 				    wp->tty, (u_long) wp->pid, wp->fd, lines,
-				    gd->hsize + gd->sy, size, ulines,
-				    gd->hsize + gd->sy, usize);
+				    gd->hsize + gd->sy, size, clines,
+				    gd->hsize + gd->sy, csize);
+				ctx->print(ctx, "%8s compressed %u/%u, %zu "
+				    "bytes (%zu uncompressed); spilled %u/%u, "
+				    "%zu bytes", "",
+				    gd->coldsize, gd->hsize + gd->sy,
+				    gd->coldbytes, gd->coldrawbytes,
+				    gd->nspilled, gd->nblocks, gd->spillbytes);
 				j++;
 			}
 		}
@@ -88,6 +88,7 @@ cmd_set_option_exec(struct cmd *self, struct cmd_ctx *ctx)
 	struct client				*c;
 	struct options				*oo;
 	struct window				*w;
+	struct window_pane			*wp;
 	const char				*optstr, *valstr;
 	u_int					 i;
 
@@ -155,8 +156,30 @@ cmd_set_option_exec(struct cmd *self, struct cmd_ctx *ctx)
 				continue;
 			if (options_get_number(&w->options, "automatic-rename"))
 				queue_window_name(w);
-			else if (event_initialized(&w->name_timer))
-				evtimer_del(&w->name_timer);
+			else
+				cancel_window_name(w);
+		}
+	}
+
+	/* Update the history spill size of every pane. */
+	if (strcmp (oe->name, "history-spill") == 0) {
+		for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
+			if ((w = ARRAY_ITEM(&windows, i)) == NULL)
+				continue;
+			TAILQ_FOREACH(wp, &w->panes, entry) {
+				wp->base.grid->spilllines =
+				    options_get_number(&w->options, oe->name);
+			}
+		}
+	}
+
+	/* These change window sizes without changing any session. */
+	if (strcmp(oe->name, "aggressive-resize") == 0 ||
+	    strcmp(oe->name, "force-width") == 0 ||
+	    strcmp(oe->name, "force-height") == 0) {
+		for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
+			if ((w = ARRAY_ITEM(&windows, i)) != NULL)
+				resize_queue_window(w);
 		}
 	}
 
@@ -67,8 +67,14 @@ cmd_swap_window_exec(struct cmd *self, struct cmd_ctx *ctx)
 		return (0);
 
 	w = wl_dst->window;
+	TAILQ_REMOVE(&w->winlinks, wl_dst, wentry);
+	TAILQ_REMOVE(&wl_src->window->winlinks, wl_src, wentry);
 	wl_dst->window = wl_src->window;
+	TAILQ_INSERT_TAIL(&wl_dst->window->winlinks, wl_dst, wentry);
 	wl_src->window = w;
+	TAILQ_INSERT_TAIL(&w->winlinks, wl_src, wentry);
+	resize_queue_window(wl_src->window);
+	resize_queue_window(wl_dst->window);
 
 	if (!args_has(self->args, 'd')) {
 		session_select(dst, wl_dst->idx);
@@ -0,0 +1,190 @@
+/* $Id$ */
+
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Simple LZ77 compression, used for old history. This is the same format as
+ * LZF: each chunk starts with a control byte. If the control byte is less
+ * than 32, it is followed by that many plus one literal bytes. Otherwise the
+ * top three bits are the length of a match minus two (if seven, the next byte
+ * is added) and the low five bits and the following byte are the offset back
+ * to the start of the match, minus one.
+ */
+
+#define COMPRESS_HASH_BITS 12
+#define COMPRESS_HASH(p) \
+	((((p)[0] << 8 | (p)[1]) ^ ((p)[2] << 4) ^ ((p)[0] >> 4)) & \
+	    ((1 << COMPRESS_HASH_BITS) - 1))
+
+#define COMPRESS_MAX_LITERAL 32
+#define COMPRESS_MAX_OFFSET 8192
+#define COMPRESS_MAX_MATCH (7 + 255 + 2)
+
+/*
+ * Compress data into a buffer. Returns the compressed size or 0 if it will
+ * not fit.
+ */
+size_t
+compress_data(const u_char *in, size_t inlen, u_char *out, size_t outlen)
+{
+	const u_char	*table[1 << COMPRESS_HASH_BITS];
+	const u_char	*ip, *end, *ref;
+	u_char		*op, *oend, *literal;
+	size_t		 len, max, offset;
+	u_int		 n, hash;
+
+	if (inlen == 0 || outlen == 0)
+		return (0);
+	memset(table, 0, sizeof table);
+
+	ip = in;
+	end = in + inlen;
+	op = out;
+	oend = out + outlen;
+
+	/* Leave space for the control byte of the first literal run. */
+	literal = op++;
+	n = 0;
+
+	while (ip + 2 < end) {
+		hash = COMPRESS_HASH(ip);
+		ref = table[hash];
+		table[hash] = ip;
+
+		if (ref != NULL &&
+		    (offset = ip - ref - 1) < COMPRESS_MAX_OFFSET &&
+		    ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+			max = end - ip;
+			if (max > COMPRESS_MAX_MATCH)
+				max = COMPRESS_MAX_MATCH;
+			for (len = 3; len < max; len++) {
+				if (ref[len] != ip[len])
+					break;
+			}
+
+			/* Finish the literal run, or drop it if empty. */
+			if (n != 0)
+				*literal = n - 1;
+			else
+				op--;
+
+			if (op + 3 + 1 > oend)
+				return (0);
+			if (len - 2 < 7)
+				*op++ = (offset >> 8) | ((len - 2) << 5);
+			else {
+				*op++ = (offset >> 8) | (7 << 5);
+				*op++ = len - 2 - 7;
+			}
+			*op++ = offset & 0xff;
+			ip += len;
+
+			literal = op++;
+			n = 0;
+			continue;
+		}
+
+		if (op >= oend)
+			return (0);
+		*op++ = *ip++;
+		if (++n == COMPRESS_MAX_LITERAL) {
+			*literal = n - 1;
+			if (op >= oend)
+				return (0);
+			literal = op++;
+			n = 0;
+		}
+	}
+
+	/* Copy any remaining bytes as literals. */
+	while (ip < end) {
+		if (op >= oend)
+			return (0);
+		*op++ = *ip++;
+		if (++n == COMPRESS_MAX_LITERAL) {
+			*literal = n - 1;
+			if (op >= oend)
+				return (0);
+			literal = op++;
+			n = 0;
+		}
+	}
+	if (n != 0)
+		*literal = n - 1;
+	else
+		op--;
+
+	return (op - out);
+}
+
+/*
+ * Decompress data into a buffer. Returns the decompressed size or 0 if the
+ * data is invalid or will not fit.
+ */
+size_t
+decompress_data(const u_char *in, size_t inlen, u_char *out, size_t outlen)
+{
+	const u_char	*ip, *end;
+	u_char		*op, *oend, *ref;
+	size_t		 len, offset;
+	u_int		 ctrl;
+
+	ip = in;
+	end = in + inlen;
+	op = out;
+	oend = out + outlen;
+
+	while (ip < end) {
+		ctrl = *ip++;
+
+		if (ctrl < COMPRESS_MAX_LITERAL) {
+			len = ctrl + 1;
+			if (ip + len > end || op + len > oend)
+				return (0);
+			memcpy(op, ip, len);
+			op += len;
+			ip += len;
+			continue;
+		}
+
+		len = ctrl >> 5;
+		if (len == 7) {
+			if (ip >= end)
+				return (0);
+			len += *ip++;
+		}
+		len += 2;
+		if (ip >= end)
+			return (0);
+		offset = ((ctrl & 0x1f) << 8 | *ip++) + 1;
+		if (offset > (size_t) (op - out) || op + len > oend)
+			return (0);
+
+		/* Copy byte by byte: the match may overlap the output. */
+		ref = op - offset;
+		while (len-- != 0)
+			*op++ = *ref++;
+	}
+
+	return (op - out);
+}
@@ -307,6 +307,11 @@ format_client(struct format_tree *ft, struct client *c)
 	format_add(ft, "client_width", "%u", c->tty.sx);
 	format_add(ft, "client_tty", "%s", c->tty.path);
 	format_add(ft, "client_termname", "%s", c->tty.termname);
+	if (c->tty.flags & TTY_OPENED) {
+		format_add(ft, "client_backlog", "%zu",
+		    EVBUFFER_LENGTH(c->tty.event->output));
+	} else
+		format_add(ft, "client_backlog", "%d", 0);
 
 	t = c->creation_time.tv_sec;
 	format_add(ft, "client_created", "%ld", (long) t);
@@ -365,13 +370,12 @@ format_window_pane(struct format_tree *ft, struct window_pane *wp)
 	u_int			 i;
 	u_int			 idx;
 
-	size = 0;
-	for (i = 0; i < gd->hsize; i++) {
-		gl = &gd->linedata[i];
-		size += gl->cellsize * sizeof *gl->celldata;
-		size += gl->utf8size * sizeof *gl->utf8data;
+	size = gd->coldbytes;
+	for (i = gd->coldsize; i < gd->hsize; i++) {
+		gl = grid_get_line(gd, i);
+		size += grid_line_memory(gl);
 	}
-	size += gd->hsize * sizeof *gd->linedata;
+	size += (gd->hsize - gd->coldsize) * sizeof *gd->linedata;
 
 	if (window_pane_index(wp, &idx) != 0)
 		fatalx("index not found");
@@ -383,6 +387,11 @@ format_window_pane(struct format_tree *ft, struct window_pane *wp)
 	format_add(ft, "history_size", "%u", gd->hsize);
 	format_add(ft, "history_limit", "%u", gd->hlimit);
 	format_add(ft, "history_bytes", "%llu", size);
+	format_add(ft, "history_compressed_bytes", "%zu",
+	    gd->coldbytes + gd->spillbytes);
+	format_add(ft, "history_uncompressed_bytes", "%zu",
+	    gd->coldrawbytes);
+	format_add(ft, "history_spilled_bytes", "%zu", gd->spillbytes);
 	format_add(ft, "pane_id", "%%%u", wp->id);
 	format_add(ft, "pane_active", "%d", wp == wp->window->active);
 	format_add(ft, "pane_dead", "%d", wp->fd == -1);
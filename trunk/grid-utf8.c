@@ -24,7 +24,185 @@
 
 /*
  * Grid UTF-8 utility functions.
+ *
+ * UTF-8 data for grid cells is kept once in a table shared by all grids and
+ * the cell holds its index in the table instead of a character. An index may
+ * be copied between cells and grids freely and two UTF-8 cells are the same if
+ * their indexes are the same.
+ *
+ * Entries are not freed as soon as the last cell using them goes. Instead,
+ * once the table has doubled in size since it was last checked, every cell
+ * which may hold an index is marked and the entries which were not marked are
+ * freed and their indexes used again. This is done from the server loop so no
+ * index is being held anywhere else. The table is counted in grid_memory.
+ */
+
+/* Check the table once it has at least this many entries. */
+#define GRID_UTF8_COLLECT 1024
+
+/* UTF-8 table entry. */
+struct grid_utf8_entry {
+	struct grid_utf8	gu;
+	u_int			index;
+
+	RB_ENTRY(grid_utf8_entry) entry;
+};
+RB_HEAD(grid_utf8_tree, grid_utf8_entry);
+
+int	grid_utf8_cmp(struct grid_utf8_entry *, struct grid_utf8_entry *);
+RB_PROTOTYPE(grid_utf8_tree, grid_utf8_entry, entry, grid_utf8_cmp);
+RB_GENERATE(grid_utf8_tree, grid_utf8_entry, entry, grid_utf8_cmp);
+
+struct grid_utf8_tree	 grid_utf8_tree = RB_INITIALIZER(&grid_utf8_tree);
+struct grid_utf8_entry **grid_utf8_list;	/* NULL if index is free */
+u_int			 grid_utf8_count;	/* indexes handed out */
+u_int			 grid_utf8_space;
+u_int			 grid_utf8_live;	/* entries in use */
+
+u_int			*grid_utf8_free;	/* free indexes */
+u_int			 grid_utf8_nfree;
+
+u_int			 grid_utf8_limit = GRID_UTF8_COLLECT;
+u_char			*grid_utf8_marks;
+
+/* Shown instead of an entry which has been freed. */
+const struct grid_utf8	 grid_utf8_missing = {
+	1, { 0xef, 0xbf, 0xbd, 0xff }
+};
+
+int
+grid_utf8_cmp(struct grid_utf8_entry *gue1, struct grid_utf8_entry *gue2)
+{
+	if (gue1->gu.width != gue2->gu.width)
+		return (gue1->gu.width - gue2->gu.width);
+	return (memcmp(gue1->gu.data, gue2->gu.data, sizeof gue1->gu.data));
+}
+
+/* Find UTF-8 data in the table, adding it if not present, and get its index. */
+u_int
+grid_utf8_add(const struct grid_utf8 *gu)
+{
+	struct grid_utf8_entry	 find, *gue;
+	size_t			 size;
+	u_int			 space;
+
+	/* Anything after the terminator is ignored, so clear it. */
+	size = grid_utf8_size(gu);
+	memset(&find.gu, 0xff, sizeof find.gu);
+	memcpy(find.gu.data, gu->data, size);
+	find.gu.width = gu->width;
+
+	if ((gue = RB_FIND(grid_utf8_tree, &grid_utf8_tree, &find)) != NULL)
+		return (gue->index);
+
+	gue = xmalloc(sizeof *gue);
+	memcpy(&gue->gu, &find.gu, sizeof gue->gu);
+	grid_memory += sizeof *gue;
+
+	if (grid_utf8_nfree != 0)
+		gue->index = grid_utf8_free[--grid_utf8_nfree];
+	else {
+		if (grid_utf8_count == grid_utf8_space) {
+			space = grid_utf8_space;
+			if (grid_utf8_space == 0)
+				grid_utf8_space = 64;
+			else
+				grid_utf8_space *= 2;
+			grid_utf8_list = xrealloc(grid_utf8_list,
+			    grid_utf8_space, sizeof *grid_utf8_list);
+			grid_utf8_free = xrealloc(grid_utf8_free,
+			    grid_utf8_space, sizeof *grid_utf8_free);
+			grid_memory += (grid_utf8_space - space) *
+			    (sizeof *grid_utf8_list + sizeof *grid_utf8_free);
+		}
+		gue->index = grid_utf8_count++;
+	}
+	RB_INSERT(grid_utf8_tree, &grid_utf8_tree, gue);
+
+	grid_utf8_list[gue->index] = gue;
+	grid_utf8_live++;
+	return (gue->index);
+}
+
+/* Get UTF-8 data from the table. */
+const struct grid_utf8 *
+grid_utf8_get(u_int idx)
+{
+	if (idx >= grid_utf8_count || grid_utf8_list[idx] == NULL) {
+		log_debug("bad UTF-8 index %u", idx);
+		return (&grid_utf8_missing);
+	}
+	return (&grid_utf8_list[idx]->gu);
+}
+
+/* Get the number of entries in the table. */
+u_int
+grid_utf8_entries(void)
+{
+	return (grid_utf8_live);
+}
+
+/* Check the table the next time the server looks at it. */
+void
+grid_utf8_want_collect(void)
+{
+	grid_utf8_limit = 0;
+}
+
+/*
+ * Start looking for unused entries if the table has grown enough. If this
+ * returns 1, every index in use must be passed to grid_utf8_mark and then
+ * grid_utf8_collect called.
  */
+int
+grid_utf8_mark_start(void)
+{
+	if (grid_utf8_live == 0 || grid_utf8_live < grid_utf8_limit)
+		return (0);
+	grid_utf8_marks = xcalloc((grid_utf8_count + 7) / 8, 1);
+	return (1);
+}
+
+/* Mark an entry as in use. */
+void
+grid_utf8_mark(u_int idx)
+{
+	if (idx < grid_utf8_count)
+		grid_utf8_marks[idx / 8] |= 1 << (idx % 8);
+}
+
+/* Free every entry which was not marked. */
+void
+grid_utf8_collect(void)
+{
+	struct grid_utf8_entry	*gue;
+	u_int			 idx, freed;
+
+	freed = 0;
+	for (idx = 0; idx < grid_utf8_count; idx++) {
+		if ((gue = grid_utf8_list[idx]) == NULL)
+			continue;
+		if (grid_utf8_marks[idx / 8] & (1 << (idx % 8)))
+			continue;
+
+		RB_REMOVE(grid_utf8_tree, &grid_utf8_tree, gue);
+		xfree(gue);
+		grid_memory -= sizeof *gue;
+
+		grid_utf8_list[idx] = NULL;
+		grid_utf8_free[grid_utf8_nfree++] = idx;
+		grid_utf8_live--;
+		freed++;
+	}
+
+	xfree(grid_utf8_marks);
+	grid_utf8_marks = NULL;
+
+	grid_utf8_limit = grid_utf8_live * 2;
+	if (grid_utf8_limit < GRID_UTF8_COLLECT)
+		grid_utf8_limit = GRID_UTF8_COLLECT;
+	log_debug("freed %u UTF-8 entries, %u left", freed, grid_utf8_live);
+}
 
 /* Calculate UTF-8 grid cell size. Data is terminated by 0xff. */
 size_t
@@ -80,17 +258,3 @@ grid_utf8_append(struct grid_utf8 *gu, const struct utf8_data *utf8data)
 		gu->data[old_size + utf8data->size] = 0xff;
 	return (0);
 }
-
-/* Compare two UTF-8 cells. */
-int
-grid_utf8_compare(const struct grid_utf8 *gu1, const struct grid_utf8 *gu2)
-{
-	size_t	size;
-
-	size = grid_utf8_size(gu1);
-	if (size != grid_utf8_size(gu2))
-		return (0);
-	if (memcmp(gu1->data, gu2->data, size) != 0)
-		return (0);
-	return (1);
-}
@@ -17,8 +17,13 @@
  */
 
 #include <sys/types.h>
+#include <sys/mman.h>
 
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "tmux.h"
 
@@ -32,22 +37,149 @@
  * (hsize - 1); from hsize to hsize + (sy - 1) is the viewable data. All
  * functions in this file work on absolute coordinates, grid-view.c has
  * functions which work on the screen data.
+ *
+ * The lines themselves are kept in a circular array: line 0 is at index
+ * lineoff of linedata and the array wraps at linesize. This means scrolling a
+ * line into the history and freeing the oldest lines never has to move the
+ * rest of the history; grid_get_line translates a line number to its entry.
+ *
+ * Lines in the history are rarely changed, so when a line scrolls off the
+ * screen it is converted into a compact form: runs of cells with the same
+ * attributes, one byte of data per cell and the UTF-8 table index only for the
+ * cells which need it. Compact lines are decoded into a per-grid cache for
+ * reading and converted back to the normal form if they are written to.
+ *
+ * Once there are more than GRID_COLD_LINES lines in the history, the oldest
+ * are packed GRID_BLOCK_LINES at a time into compressed blocks and removed
+ * from the line array; line 0 of the array is then line coldsize of the grid.
+ * Blocks are decompressed when a line in them is needed and a few of the most
+ * recently used are kept decompressed. If a line in a block needs to be
+ * changed, the blocks back to that line are unpacked into the array again.
+ *
+ * If spilllines is not zero, blocks with lines older than that are written to
+ * a temporary file instead of being kept in memory. The file is unlinked as
+ * soon as it is created and mapped to read the blocks back; blocks are always
+ * spilled oldest first so the spilled blocks are the first nspilled.
+ *
+ * The memory used by each grid for its lines is counted in the memory member
+ * and the total for all grids in grid_memory. This does not include spilled
+ * blocks or the shared cache of decompressed blocks.
  */
 
 /* Default grid cell data. */
 const struct grid_cell grid_default_cell = { 0, 0, 8, 8, ' ' };
 const struct grid_cell grid_marker_cell = { 0, 0, 8, 8, '_' };
 
+#define grid_ring_index(gd, ry)					\
+	((gd)->lineoff + (ry) >= (gd)->linesize ?		\
+	    (gd)->lineoff + (ry) - (gd)->linesize : (gd)->lineoff + (ry))
+#define grid_ring_line(gd, ry) (&(gd)->linedata[grid_ring_index(gd, ry)])
+#define grid_line(gd, py) ((py) < (gd)->coldsize ?			\
+	grid_block_line(gd, py) : grid_ring_line(gd, (py) - (gd)->coldsize))
+
 #define grid_put_cell(gd, px, py, gc) do {			\
-	memcpy(&gd->linedata[py].celldata[px], 			\
-	    gc, sizeof gd->linedata[py].celldata[px]);		\
+	memcpy(&grid_line(gd, py)->celldata[px], 		\
+	    gc, sizeof grid_line(gd, py)->celldata[px]);	\
 } while (0)
-#define grid_put_utf8(gd, px, py, gc) do {			\
-	memcpy(&gd->linedata[py].utf8data[px], 			\
-	    gc, sizeof gd->linedata[py].utf8data[px]);		\
+
+/*
+ * Compact line header, followed by runs, one byte of data for each cell and
+ * the UTF-8 table index for each UTF-8 cell.
+ */
+struct grid_compact {
+	u_int	ncells;
+	u_int	nruns;
+	u_int	nutf8;
+} __packed;
+
+/* Run of cells with the same attributes in a compact line. */
+struct grid_run {
+	u_char	attr;
+	u_char	flags;
+	u_char	fg;
+	u_char	bg;
+	u_char	length;
+} __packed;
+
+#define grid_compact_runs(gcp) ((struct grid_run *) ((gcp) + 1))
+#define grid_compact_data(gcp) \
+	((u_char *) (grid_compact_runs(gcp) + (gcp)->nruns))
+#define grid_compact_utf8(gcp) (grid_compact_data(gcp) + (gcp)->ncells)
+
+/* Number of lines in a block and recent history lines not put in blocks. */
+#define GRID_BLOCK_LINES 128
+#define GRID_COLD_LINES 1000
+
+/* Number of blocks kept decompressed. */
+#define GRID_BLOCK_CACHE 8
+
+/* Block of old history lines. */
+struct grid_block {
+	struct grid	*grid;
+
+	u_char		*data;		/* compressed, NULL if spilled */
+	off_t		 offset;	/* offset in spill file */
+	size_t		 size;
+	size_t		 rawsize;
+
+	u_char		*raw;		/* decompressed lines if cached */
+	struct grid_line *lines;
+
+	u_int		*utf8;		/* UTF-8 indexes used, sorted */
+	u_int		 nutf8;
+
+	TAILQ_ENTRY(grid_block) entry;
+};
+TAILQ_HEAD(grid_blocks, grid_block);
+
+/* Line header in a block, followed by the compact line if size is not 0. */
+struct grid_block_header {
+	int	flags;
+	u_int	size;
+} __packed;
+
+/* Memory used by all grids. */
+size_t		   grid_memory;
+
+/* All grids, so the UTF-8 indexes they use can be found. */
+TAILQ_HEAD(, grid) grids = TAILQ_HEAD_INITIALIZER(grids);
+
+#define grid_memory_add(gd, n) do {				\
+	(gd)->memory += (n);					\
+	grid_memory += (n);					\
 } while (0)
+#define grid_memory_sub(gd, n) do {				\
+	(gd)->memory -= (n);					\
+	grid_memory -= (n);					\
+} while (0)
+
+/* Decompressed blocks, most recently used first. */
+struct grid_blocks grid_blocks_cached =
+    TAILQ_HEAD_INITIALIZER(grid_blocks_cached);
+u_int		   grid_blocks_ncached;
+
+#define grid_same_attributes(gc1, gc2)					\
+	((gc1)->attr == (gc2)->attr && (gc1)->flags == (gc2)->flags &&	\
+	    (gc1)->fg == (gc2)->fg && (gc1)->bg == (gc2)->bg)
 
 int	grid_check_y(struct grid *, u_int);
+void	grid_reserve_lines(struct grid *, u_int);
+size_t	grid_compact_size(const struct grid_compact *);
+void	grid_compact_decode(const struct grid_compact *, struct grid_cell *);
+void	grid_compact_free(struct grid *, struct grid_line *);
+void	grid_cache_line(struct grid *, struct grid_line *);
+int	grid_spill_open(struct grid *);
+int	grid_spill_map(struct grid *);
+void	grid_spill_history(struct grid *);
+void	grid_spill_trim(struct grid *);
+struct grid_line *grid_block_line(struct grid *, u_int);
+int	grid_block_load(struct grid_block *);
+void	grid_block_unload(struct grid_block *);
+void	grid_block_free(struct grid_block *);
+void	grid_freeze_history(struct grid *);
+int	grid_utf8_index_cmp(const void *, const void *);
+void	grid_block_index_utf8(struct grid *, struct grid_block *);
+void	grid_mark_line(const struct grid_line *);
 
 #ifdef DEBUG
 int
@@ -85,7 +217,32 @@ grid_create(u_int sx, u_int sy, u_int hlimit)
 	gd->hlimit = hlimit;
 
 	gd->linedata = xcalloc(gd->sy, sizeof *gd->linedata);
-
+	gd->linesize = gd->sy;
+	gd->lineoff = 0;
+
+	gd->memory = 0;
+	grid_memory_add(gd, gd->linesize * sizeof *gd->linedata);
+
+	gd->cachesrc = NULL;
+	gd->cachecells = NULL;
+	gd->cachesize = 0;
+
+	gd->blocks = NULL;
+	gd->nblocks = 0;
+	gd->coldsize = 0;
+	gd->coldoff = 0;
+	gd->coldbytes = 0;
+	gd->coldrawbytes = 0;
+
+	gd->spilllines = 0;
+	gd->spillfd = -1;
+	gd->spillmap = NULL;
+	gd->spillmapsize = 0;
+	gd->spillsize = 0;
+	gd->nspilled = 0;
+	gd->spillbytes = 0;
+
+	TAILQ_INSERT_TAIL(&grids, gd, entry);
 	return (gd);
 }
 
@@ -96,16 +253,32 @@ grid_destroy(struct grid *gd)
 	struct grid_line	*gl;
 	u_int			 yy;
 
-	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
-		gl = &gd->linedata[yy];
+	for (yy = gd->coldsize; yy < gd->hsize + gd->sy; yy++) {
+		gl = grid_line(gd, yy);
 		if (gl->celldata != NULL)
 			xfree(gl->celldata);
-		if (gl->utf8data != NULL)
-			xfree(gl->utf8data);
+		if (gl->compactdata != NULL)
+			xfree(gl->compactdata);
 	}
 
 	xfree(gd->linedata);
 
+	for (yy = 0; yy < gd->nblocks; yy++)
+		grid_block_free(gd->blocks[yy]);
+	if (gd->blocks != NULL)
+		xfree(gd->blocks);
+
+	if (gd->spillmap != NULL)
+		munmap(gd->spillmap, gd->spillmapsize);
+	if (gd->spillfd != -1)
+		close(gd->spillfd);
+
+	if (gd->cachecells != NULL)
+		xfree(gd->cachecells);
+
+	grid_memory -= gd->memory;
+
+	TAILQ_REMOVE(&grids, gd, entry);
 	xfree(gd);
 }
 
@@ -114,38 +287,268 @@ int
 grid_compare(struct grid *ga, struct grid *gb)
 {
 	struct grid_line	*gla, *glb;
-	struct grid_cell	*gca, *gcb;
-	struct grid_utf8	*gua, *gub;
+	const struct grid_cell	*gca, *gcb;
 	u_int			 xx, yy;
 
 	if (ga->sx != gb->sx || ga->sy != ga->sy)
 		return (1);
 
 	for (yy = 0; yy < ga->sy; yy++) {
-		gla = &ga->linedata[yy];
-		glb = &gb->linedata[yy];
+		gla = grid_line(ga, yy);
+		glb = grid_line(gb, yy);
 		if (gla->cellsize != glb->cellsize)
 			return (1);
-		for (xx = 0; xx < ga->sx; xx++) {
-			gca = &gla->celldata[xx];
-			gcb = &glb->celldata[xx];
+		for (xx = 0; xx < gla->cellsize; xx++) {
+			gca = grid_peek_cell(ga, xx, yy);
+			gcb = grid_peek_cell(gb, xx, yy);
 			if (memcmp(gca, gcb, sizeof (struct grid_cell)) != 0)
 				return (1);
-			if (!(gca->flags & GRID_FLAG_UTF8))
-				continue;
-			gua = &gla->utf8data[xx];
-			gub = &glb->utf8data[xx];
-			if (memcmp(gua, gub, sizeof (struct grid_utf8)) != 0)
-				return (1);
 		}
 	}
 
 	return (0);
 }
 
+/* Get a line by its absolute position. */
+struct grid_line *
+grid_get_line(struct grid *gd, u_int py)
+{
+	return (grid_line(gd, py));
+}
+
+/* Get the memory used by the cells of a line. */
+size_t
+grid_line_memory(const struct grid_line *gl)
+{
+	if (gl->compactdata != NULL)
+		return (grid_compact_size(gl->compactdata));
+	return (gl->cellsize * sizeof *gl->celldata);
+}
+
+/* Get the size of a compact line. */
+size_t
+grid_compact_size(const struct grid_compact *gcp)
+{
+	size_t	size;
+
+	size = sizeof *gcp;
+	size += gcp->nruns * sizeof (struct grid_run);
+	size += gcp->ncells;
+	size += gcp->nutf8 * sizeof (u_int);
+	return (size);
+}
+
+/* Convert a line into compact form. */
+void
+grid_compact_line(struct grid *gd, u_int py)
+{
+	struct grid_line	*gl;
+	struct grid_compact	*gcp;
+	struct grid_run		*run;
+	struct grid_cell	*gc;
+	u_char			*data, *utf8;
+	u_int			 xx, nruns, nutf8, length;
+
+	if (py < gd->coldsize)
+		return;
+	gl = grid_line(gd, py);
+	if (gl->compactdata != NULL || gl->cellsize == 0)
+		return;
+
+	/* Work out how many runs and UTF-8 cells are needed. */
+	nruns = nutf8 = length = 0;
+	for (xx = 0; xx < gl->cellsize; xx++) {
+		gc = &gl->celldata[xx];
+		if (length == 0 || length == UCHAR_MAX ||
+		    !grid_same_attributes(gc, gc - 1)) {
+			nruns++;
+			length = 0;
+		}
+		length++;
+		if (gc->flags & GRID_FLAG_UTF8)
+			nutf8++;
+	}
+
+	gcp = xmalloc(sizeof *gcp + nruns * sizeof *run + gl->cellsize +
+	    nutf8 * sizeof gc->data);
+	gcp->ncells = gl->cellsize;
+	gcp->nruns = nruns;
+	gcp->nutf8 = nutf8;
+
+	/* Fill in the runs, the cell data and the UTF-8 indexes. */
+	run = NULL;
+	data = grid_compact_data(gcp);
+	utf8 = grid_compact_utf8(gcp);
+	for (xx = 0; xx < gl->cellsize; xx++) {
+		gc = &gl->celldata[xx];
+		if (run == NULL || run->length == UCHAR_MAX ||
+		    !grid_same_attributes(gc, gc - 1)) {
+			if (run == NULL)
+				run = grid_compact_runs(gcp);
+			else
+				run++;
+			run->attr = gc->attr;
+			run->flags = gc->flags;
+			run->fg = gc->fg;
+			run->bg = gc->bg;
+			run->length = 0;
+		}
+		run->length++;
+
+		data[xx] = gc->data;
+		if (gc->flags & GRID_FLAG_UTF8) {
+			memcpy(utf8, &gc->data, sizeof gc->data);
+			utf8 += sizeof gc->data;
+		}
+	}
+
+	grid_memory_sub(gd, grid_line_memory(gl));
+
+	xfree(gl->celldata);
+	gl->celldata = NULL;
+
+	gl->compactdata = gcp;
+	grid_memory_add(gd, grid_compact_size(gcp));
+}
+
+/* Decode a compact line into a cell array. */
+void
+grid_compact_decode(const struct grid_compact *gcp, struct grid_cell *celldata)
+{
+	const struct grid_run	*run;
+	const u_char		*data, *utf8;
+	struct grid_cell	*gc;
+	u_int			 i, xx, n;
+
+	run = grid_compact_runs(gcp);
+	data = grid_compact_data(gcp);
+	utf8 = grid_compact_utf8(gcp);
+
+	xx = 0;
+	for (i = 0; i < gcp->nruns; i++, run++) {
+		for (n = 0; n < run->length; n++, xx++) {
+			gc = &celldata[xx];
+			gc->attr = run->attr;
+			gc->flags = run->flags;
+			gc->fg = run->fg;
+			gc->bg = run->bg;
+			if (run->flags & GRID_FLAG_UTF8) {
+				memcpy(&gc->data, utf8, sizeof gc->data);
+				utf8 += sizeof gc->data;
+			} else
+				gc->data = data[xx];
+		}
+	}
+}
+
+/* Free the compact form of a line, dropping it from the cache if present. */
+void
+grid_compact_free(struct grid *gd, struct grid_line *gl)
+{
+	if (gd->cachesrc == gl->compactdata)
+		gd->cachesrc = NULL;
+	grid_memory_sub(gd, grid_compact_size(gl->compactdata));
+	xfree(gl->compactdata);
+	gl->compactdata = NULL;
+}
+
+/*
+ * Convert a compact line back into normal form so it may be changed. Returns
+ * -1 if the line is in a block which cannot be read.
+ */
+int
+grid_inflate_line(struct grid *gd, u_int py)
+{
+	struct grid_line	*gl;
+	struct grid_compact	*gcp;
+
+	if (grid_thaw_lines(gd, py) != 0)
+		return (-1);
+
+	gl = grid_line(gd, py);
+	if ((gcp = gl->compactdata) == NULL)
+		return (0);
+
+	gl->celldata = xcalloc(gcp->ncells, sizeof *gl->celldata);
+	grid_memory_add(gd, gcp->ncells * sizeof *gl->celldata);
+	grid_compact_decode(gcp, gl->celldata);
+
+	grid_compact_free(gd, gl);
+	return (0);
+}
+
+/* Decode a compact line into the cache for reading, if not already there. */
+void
+grid_cache_line(struct grid *gd, struct grid_line *gl)
+{
+	struct grid_compact	*gcp = gl->compactdata;
+
+	if (gd->cachesrc == gcp)
+		return;
+
+	if (gcp->ncells > gd->cachesize) {
+		gd->cachecells = xrealloc(
+		    gd->cachecells, gcp->ncells, sizeof *gd->cachecells);
+		grid_memory_add(gd,
+		    (gcp->ncells - gd->cachesize) * sizeof *gd->cachecells);
+		gd->cachesize = gcp->ncells;
+	}
+	grid_compact_decode(gcp, gd->cachecells);
+
+	gd->cachesrc = gcp;
+}
+
+/*
+ * Make sure there is room for at least ny lines (including any in blocks,
+ * which are not in the array). The array is grown by
+ * doubling (but not beyond what the history limit allows) and unwrapped so
+ * line 0 is back at the start.
+ */
+void
+grid_reserve_lines(struct grid *gd, u_int ny)
+{
+	struct grid_line	*linedata;
+	u_int			 size, first;
+
+	ny -= gd->coldsize;
+	if (ny <= gd->linesize)
+		return;
+
+	size = gd->linesize * 2;
+	if (size > gd->hlimit + gd->sy + 1)
+		size = gd->hlimit + gd->sy + 1;
+	if (size < ny)
+		size = ny;
+
+	linedata = xcalloc(size, sizeof *linedata);
+	first = gd->linesize - gd->lineoff;
+	memcpy(linedata, &gd->linedata[gd->lineoff], first * sizeof *linedata);
+	memcpy(linedata + first, gd->linedata, gd->lineoff * sizeof *linedata);
+	xfree(gd->linedata);
+	grid_memory_add(gd, (size - gd->linesize) * sizeof *linedata);
+
+	gd->linedata = linedata;
+	gd->linesize = size;
+	gd->lineoff = 0;
+}
+
+/*
+ * Make sure the grid can hold ny lines (history and visible) and clear any
+ * lines which are newly brought into use. Lines beyond ny are left alone.
+ */
+void
+grid_adjust_lines(struct grid *gd, u_int oldny, u_int ny)
+{
+	u_int	yy;
+
+	grid_reserve_lines(gd, ny);
+	for (yy = oldny; yy < ny; yy++)
+		memset(grid_line(gd, yy), 0, sizeof *gd->linedata);
+}
+
 /*
  * Collect lines from the history if at the limit. Free the top (oldest) 10%
- * and shift up.
+ * and advance the start of the array over them.
  */
 void
 grid_collect_history(struct grid *gd)
@@ -161,13 +564,605 @@ grid_collect_history(struct grid *gd)
 	if (yy < 1)
 		yy = 1;
 
-	grid_move_lines(gd, 0, yy, gd->hsize + gd->sy - yy);
-	gd->hsize -= yy;
+	grid_drop_history(gd, yy);
+}
+
+/* Free the entire history, leaving only the visible lines. */
+void
+grid_clear_history(struct grid *gd)
+{
+	GRID_DEBUG(gd, "");
+
+	grid_drop_history(gd, gd->hsize);
+	grid_utf8_want_collect();
+}
+
+/* Free the oldest ny lines of the history. */
+void
+grid_drop_history(struct grid *gd, u_int ny)
+{
+	u_int	n;
+
+	if (ny > gd->hsize)
+		ny = gd->hsize;
+	if (ny == 0)
+		return;
+
+	/* Drop lines from the blocks first, freeing any which are finished. */
+	n = ny;
+	if (n > gd->coldsize)
+		n = gd->coldsize;
+	gd->coldsize -= n;
+	gd->coldoff += n;
+	gd->hsize -= n;
+	while (gd->nblocks != 0 &&
+	    (gd->coldsize == 0 || gd->coldoff >= GRID_BLOCK_LINES)) {
+		grid_block_free(gd->blocks[0]);
+		memmove(&gd->blocks[0], &gd->blocks[1],
+		    (gd->nblocks - 1) * sizeof *gd->blocks);
+		gd->nblocks--;
+		if (gd->coldoff >= GRID_BLOCK_LINES)
+			gd->coldoff -= GRID_BLOCK_LINES;
+	}
+	if (gd->coldsize == 0)
+		gd->coldoff = 0;
+	grid_spill_trim(gd);
+
+	/* Then free the rest and advance the start of the array over them. */
+	n = ny - n;
+	if (n != 0) {
+		grid_clear_lines(gd, 0, n);
+		gd->lineoff = (gd->lineoff + n) % gd->linesize;
+		gd->hsize -= n;
+	}
+}
+
+/*
+ * Get a line from a block, loading the block if necessary. If the block cannot
+ * be loaded, an empty line is returned instead.
+ */
+struct grid_line *
+grid_block_line(struct grid *gd, u_int py)
+{
+	static struct grid_line	 empty;
+	struct grid_block	*gb;
+
+	py += gd->coldoff;
+	gb = gd->blocks[py / GRID_BLOCK_LINES];
+	if (grid_block_load(gb) != 0) {
+		memset(&empty, 0, sizeof empty);
+		return (&empty);
+	}
+	return (&gb->lines[py % GRID_BLOCK_LINES]);
+}
+
+/*
+ * Decompress a block and make it the most recently used. Returns -1 if the
+ * block cannot be read, in which case it is left unloaded to be tried again
+ * next time.
+ */
+int
+grid_block_load(struct grid_block *gb)
+{
+	struct grid			*gd = gb->grid;
+	struct grid_block_header	*gbh;
+	struct grid_line		*gl;
+	u_char				*data, *copy, *ptr;
+	ssize_t				 n;
+	u_int				 i;
+
+	if (gb->lines != NULL) {
+		if (gb != TAILQ_FIRST(&grid_blocks_cached)) {
+			TAILQ_REMOVE(&grid_blocks_cached, gb, entry);
+			TAILQ_INSERT_HEAD(&grid_blocks_cached, gb, entry);
+		}
+		return (0);
+	}
+
+	if (grid_blocks_ncached == GRID_BLOCK_CACHE)
+		grid_block_unload(TAILQ_LAST(&grid_blocks_cached, grid_blocks));
+	gb->lines = xcalloc(GRID_BLOCK_LINES, sizeof *gb->lines);
+	TAILQ_INSERT_HEAD(&grid_blocks_cached, gb, entry);
+	grid_blocks_ncached++;
+
+	/*
+	 * Spilled blocks are read through the mapping into memory, or read
+	 * from the file if it cannot be mapped.
+	 */
+	data = gb->data;
+	copy = NULL;
+	if (data == NULL) {
+		if (grid_spill_map(gd) == 0)
+			data = gd->spillmap + gb->offset;
+		else {
+			copy = xmalloc(gb->size);
+			n = pread(gd->spillfd, copy, gb->size, gb->offset);
+			if (n == -1 || (size_t) n != gb->size) {
+				log_debug("history block read failed");
+				xfree(copy);
+				grid_block_unload(gb);
+				return (-1);
+			}
+			data = copy;
+		}
+	}
+
+	if (gb->size == gb->rawsize && gb->data != NULL)
+		gb->raw = gb->data;
+	else if (gb->size == gb->rawsize && copy != NULL) {
+		gb->raw = copy;
+		copy = NULL;
+	} else if (gb->size == gb->rawsize) {
+		gb->raw = xmalloc(gb->rawsize);
+		memcpy(gb->raw, data, gb->rawsize);
+	} else {
+		gb->raw = xmalloc(gb->rawsize);
+		if (decompress_data(data,
+		    gb->size, gb->raw, gb->rawsize) != gb->rawsize) {
+			log_debug("bad history block");
+			xfree(gb->raw);
+			gb->raw = NULL;
+		}
+	}
+	if (copy != NULL)
+		xfree(copy);
+	if (gb->raw == NULL) {
+		grid_block_unload(gb);
+		return (-1);
+	}
+
+	ptr = gb->raw;
+	for (i = 0; i < GRID_BLOCK_LINES; i++) {
+		gbh = (struct grid_block_header *) ptr;
+		ptr += sizeof *gbh;
+
+		gl = &gb->lines[i];
+		gl->flags = gbh->flags;
+		if (gbh->size != 0) {
+			gl->compactdata = (struct grid_compact *) ptr;
+			gl->cellsize = gl->compactdata->ncells;
+		}
+		ptr += gbh->size;
+	}
+	return (0);
+}
+
+/* Drop the decompressed copy of a block. */
+void
+grid_block_unload(struct grid_block *gb)
+{
+	if (gb->lines == NULL)
+		return;
+
+	/* The line cache may be pointing into this block. */
+	gb->grid->cachesrc = NULL;
+
+	xfree(gb->lines);
+	gb->lines = NULL;
+	if (gb->raw != NULL && gb->raw != gb->data)
+		xfree(gb->raw);
+	gb->raw = NULL;
+
+	TAILQ_REMOVE(&grid_blocks_cached, gb, entry);
+	grid_blocks_ncached--;
+}
+
+/* Free a block. */
+void
+grid_block_free(struct grid_block *gb)
+{
+	struct grid	*gd = gb->grid;
+
+	grid_block_unload(gb);
+
+	if (gb->data == NULL) {
+		gd->spillbytes -= gb->size;
+		gd->nspilled--;
+	} else {
+		gd->coldbytes -= gb->size;
+		grid_memory_sub(gd, gb->size);
+		xfree(gb->data);
+	}
+	gd->coldrawbytes -= gb->rawsize;
+
+	if (gb->utf8 != NULL) {
+		grid_memory_sub(gd, gb->nutf8 * sizeof *gb->utf8);
+		xfree(gb->utf8);
+	}
+	xfree(gb);
+}
+
+/*
+ * Pack the oldest history lines into blocks if there are more than
+ * GRID_COLD_LINES lines in the history which are not already in blocks.
+ */
+void
+grid_freeze_history(struct grid *gd)
+{
+	struct grid_block		*gb;
+	struct grid_block_header	*gbh;
+	struct grid_line		*gl;
+	u_char				*ptr;
+	size_t				 size;
+	u_int				 yy, ry;
+
+	while (gd->hsize - gd->coldsize >= GRID_COLD_LINES + GRID_BLOCK_LINES) {
+		/* Work out how big the block is. */
+		size = 0;
+		for (yy = 0; yy < GRID_BLOCK_LINES; yy++) {
+			ry = gd->coldsize + yy;
+			grid_compact_line(gd, ry);
+			gl = grid_line(gd, ry);
+
+			size += sizeof *gbh;
+			if (gl->compactdata != NULL)
+				size += grid_compact_size(gl->compactdata);
+		}
+
+		/* Copy the lines into it. */
+		gb = xmalloc(sizeof *gb);
+		gb->grid = gd;
+		gb->offset = 0;
+		gb->rawsize = size;
+		gb->raw = NULL;
+		gb->lines = NULL;
+
+		ptr = xmalloc(size);
+		for (yy = 0; yy < GRID_BLOCK_LINES; yy++) {
+			gl = grid_line(gd, gd->coldsize + yy);
+
+			gbh = (struct grid_block_header *) ptr;
+			gbh->flags = gl->flags;
+			gbh->size = 0;
+			if (gl->compactdata != NULL)
+				gbh->size = grid_compact_size(gl->compactdata);
+			ptr += sizeof *gbh;
+
+			if (gbh->size != 0)
+				memcpy(ptr, gl->compactdata, gbh->size);
+			ptr += gbh->size;
+		}
+		ptr -= size;
+
+		grid_block_index_utf8(gd, gb);
+		grid_memory_add(gd, gb->nutf8 * sizeof *gb->utf8);
+
+		/* Compress it, unless it would not be any smaller. */
+		gb->data = xmalloc(size);
+		gb->size = compress_data(ptr, size, gb->data, size - 1);
+		if (gb->size == 0) {
+			xfree(gb->data);
+			gb->data = ptr;
+			gb->size = size;
+		} else {
+			gb->data = xrealloc(gb->data, 1, gb->size);
+			xfree(ptr);
+		}
+
+		gd->blocks = xrealloc(
+		    gd->blocks, gd->nblocks + 1, sizeof *gd->blocks);
+		gd->blocks[gd->nblocks++] = gb;
+		gd->coldbytes += gb->size;
+		gd->coldrawbytes += gb->rawsize;
+		grid_memory_add(gd, gb->size);
+
+		/* Free the lines and move the start of the array past them. */
+		grid_clear_lines(gd, gd->coldsize, GRID_BLOCK_LINES);
+		gd->lineoff = (gd->lineoff + GRID_BLOCK_LINES) % gd->linesize;
+		gd->coldsize += GRID_BLOCK_LINES;
+	}
+
+	if (gd->spilllines != 0)
+		grid_spill_history(gd);
+}
+
+/* Compare UTF-8 indexes for qsort. */
+int
+grid_utf8_index_cmp(const void *a, const void *b)
+{
+	u_int	ia = *(const u_int *) a, ib = *(const u_int *) b;
+
+	if (ia < ib)
+		return (-1);
+	return (ia > ib);
+}
+
+/*
+ * Make a list of the UTF-8 indexes used by the lines going into a block, which
+ * are the next GRID_BLOCK_LINES after the blocks, so they can be marked without
+ * reading the block.
+ */
+void
+grid_block_index_utf8(struct grid *gd, struct grid_block *gb)
+{
+	struct grid_compact	*gcp;
+	u_char			*utf8;
+	u_int			 yy, i, n;
+
+	n = 0;
+	for (yy = 0; yy < GRID_BLOCK_LINES; yy++) {
+		gcp = grid_line(gd, gd->coldsize + yy)->compactdata;
+		if (gcp != NULL)
+			n += gcp->nutf8;
+	}
+	gb->utf8 = NULL;
+	gb->nutf8 = 0;
+	if (n == 0)
+		return;
+
+	gb->utf8 = xcalloc(n, sizeof *gb->utf8);
+	for (yy = 0; yy < GRID_BLOCK_LINES; yy++) {
+		gcp = grid_line(gd, gd->coldsize + yy)->compactdata;
+		if (gcp == NULL)
+			continue;
+		utf8 = grid_compact_utf8(gcp);
+		for (i = 0; i < gcp->nutf8; i++) {
+			memcpy(&gb->utf8[gb->nutf8++], utf8, sizeof *gb->utf8);
+			utf8 += sizeof *gb->utf8;
+		}
+	}
+
+	/* Sort and remove duplicates. */
+	qsort(gb->utf8, gb->nutf8, sizeof *gb->utf8, grid_utf8_index_cmp);
+	n = 1;
+	for (i = 1; i < gb->nutf8; i++) {
+		if (gb->utf8[i] != gb->utf8[n - 1])
+			gb->utf8[n++] = gb->utf8[i];
+	}
+	gb->nutf8 = n;
+	gb->utf8 = xrealloc(gb->utf8, gb->nutf8, sizeof *gb->utf8);
+}
+
+/* Mark the UTF-8 indexes used by a line. */
+void
+grid_mark_line(const struct grid_line *gl)
+{
+	const u_char	*utf8;
+	u_int		 idx, xx;
+
+	if (gl->compactdata != NULL) {
+		utf8 = grid_compact_utf8(gl->compactdata);
+		for (xx = 0; xx < gl->compactdata->nutf8; xx++) {
+			memcpy(&idx, utf8, sizeof idx);
+			utf8 += sizeof idx;
+			grid_utf8_mark(idx);
+		}
+		return;
+	}
+	for (xx = 0; xx < gl->cellsize; xx++) {
+		if (gl->celldata[xx].flags & GRID_FLAG_UTF8)
+			grid_utf8_mark(gl->celldata[xx].data);
+	}
+}
+
+/* Mark the UTF-8 indexes used by every grid. */
+void
+grid_mark_utf8(void)
+{
+	struct grid		*gd;
+	struct grid_block	*gb;
+	u_int			 yy, i;
+
+	TAILQ_FOREACH(gd, &grids, entry) {
+		for (yy = 0; yy < gd->hsize + gd->sy - gd->coldsize; yy++)
+			grid_mark_line(grid_ring_line(gd, yy));
+
+		for (yy = 0; yy < gd->nblocks; yy++) {
+			gb = gd->blocks[yy];
+			for (i = 0; i < gb->nutf8; i++)
+				grid_utf8_mark(gb->utf8[i]);
+		}
+
+		if (gd->cachesrc != NULL) {
+			for (i = 0; i < gd->cachesrc->ncells; i++) {
+				if (gd->cachecells[i].flags & GRID_FLAG_UTF8)
+					grid_utf8_mark(gd->cachecells[i].data);
+			}
+		}
+	}
+}
+
+/* Create the spill file in the same private directory as the socket. */
+int
+grid_spill_open(struct grid *gd)
+{
+	char	path[MAXPATHLEN], *cp;
+
+	strlcpy(path, socket_path, sizeof path);
+	if ((cp = strrchr(path, '/')) != NULL)
+		*cp = '\0';
+	else
+		strlcpy(path, ".", sizeof path);
+	if (strlcat(path, "/history-XXXXXX", sizeof path) >= sizeof path)
+		return (-1);
+
+	if ((gd->spillfd = mkstemp(path)) == -1) {
+		log_debug("%s: %s", path, strerror(errno));
+		return (-1);
+	}
+	unlink(path);
+	return (0);
+}
+
+/* Make sure all of the spill file is mapped. */
+int
+grid_spill_map(struct grid *gd)
+{
+	void	*map;
+
+	if (gd->spillmap != NULL && gd->spillmapsize == gd->spillsize)
+		return (0);
+
+	if (gd->spillmap != NULL)
+		munmap(gd->spillmap, gd->spillmapsize);
+	gd->spillmap = NULL;
+	gd->spillmapsize = 0;
+
+	if (gd->spillsize == 0)
+		return (0);
+	map = mmap(NULL, gd->spillsize, PROT_READ, MAP_SHARED, gd->spillfd, 0);
+	if (map == MAP_FAILED)
+		return (-1);
+	gd->spillmap = map;
+	gd->spillmapsize = gd->spillsize;
+	return (0);
+}
+
+/*
+ * Write the oldest blocks to the spill file while there are more than
+ * spilllines lines of history in memory.
+ */
+void
+grid_spill_history(struct grid *gd)
+{
+	struct grid_block	*gb;
+	u_int			 inmemory;
+	ssize_t			 n;
+
+	for (;;) {
+		if (gd->nspilled == gd->nblocks)
+			break;
+		inmemory = gd->hsize - gd->nspilled * GRID_BLOCK_LINES;
+		if (gd->nspilled != 0)
+			inmemory += gd->coldoff;
+		if (inmemory <= gd->spilllines + GRID_BLOCK_LINES)
+			break;
+
+		if (gd->spillfd == -1 && grid_spill_open(gd) != 0) {
+			gd->spilllines = 0;
+			return;
+		}
+
+		gb = gd->blocks[gd->nspilled];
+		n = pwrite(gd->spillfd, gb->data, gb->size, gd->spillsize);
+		if (n == -1 || (size_t) n != gb->size) {
+			/* Leave the block in memory and stop spilling. */
+			log_debug("history spill failed");
+			gd->spilllines = 0;
+			return;
+		}
+
+		/* Any cached copy may point at the data so drop it. */
+		grid_block_unload(gb);
+
+		xfree(gb->data);
+		gb->data = NULL;
+		gb->offset = gd->spillsize;
+		gd->spillsize += gb->size;
+
+		gd->coldbytes -= gb->size;
+		grid_memory_sub(gd, gb->size);
+		gd->spillbytes += gb->size;
+		gd->nspilled++;
+	}
+}
+
+/*
+ * Reclaim space at the start of the spill file once the freed blocks there
+ * take up at least as much as the blocks still in use.
+ */
+void
+grid_spill_trim(struct grid *gd)
+{
+	struct grid_block	*gb;
+	off_t			 start;
+	size_t			 size;
+	ssize_t			 n;
+	u_int			 i;
+
+	if (gd->spillfd == -1 || gd->spillsize == 0)
+		return;
+
+	if (gd->nspilled == 0)
+		start = gd->spillsize;
+	else
+		start = gd->blocks[0]->offset;
+	size = gd->spillsize - start;
+	if (start == 0 || (size_t) start < size)
+		return;
+
+	/* Copy the blocks to the start; the two areas cannot overlap. */
+	if (size != 0) {
+		if (grid_spill_map(gd) != 0) {
+			/* Leave the file as it is and stop spilling. */
+			log_debug("history spill map failed");
+			gd->spilllines = 0;
+			return;
+		}
+		n = pwrite(gd->spillfd, gd->spillmap + start, size, 0);
+		if (n == -1 || (size_t) n != size)
+			return;
+		for (i = 0; i < gd->nspilled; i++) {
+			gb = gd->blocks[i];
+			gb->offset -= start;
+		}
+	}
+
+	if (gd->spillmap != NULL)
+		munmap(gd->spillmap, gd->spillmapsize);
+	gd->spillmap = NULL;
+	gd->spillmapsize = 0;
+
+	if (ftruncate(gd->spillfd, size) != 0)
+		log_debug("history spill truncate failed");
+	gd->spillsize = size;
+}
+
+/*
+ * Unpack blocks back into the line array until line py is no longer in one.
+ * Returns -1 if a block cannot be read, leaving it and any before it as they
+ * are.
+ */
+int
+grid_thaw_lines(struct grid *gd, u_int py)
+{
+	struct grid_block	*gb;
+	struct grid_line	*gl, *src;
+	size_t			 size;
+	u_int			 yy, first, n;
+
+	while (py < gd->coldsize) {
+		gb = gd->blocks[gd->nblocks - 1];
+
+		/* Work out how many lines of the last block are still used. */
+		first = 0;
+		if (gd->nblocks == 1)
+			first = gd->coldoff;
+		n = GRID_BLOCK_LINES - first;
+
+		if (grid_block_load(gb) != 0)
+			return (-1);
+
+		/* Make space at the start of the array. */
+		grid_reserve_lines(gd, gd->hsize + gd->sy + n);
+		gd->lineoff = (gd->lineoff + gd->linesize - n) % gd->linesize;
+
+		for (yy = 0; yy < n; yy++) {
+			src = &gb->lines[first + yy];
+			gl = grid_ring_line(gd, yy);
+
+			memset(gl, 0, sizeof *gl);
+			gl->flags = src->flags;
+			if (src->compactdata != NULL) {
+				size = grid_compact_size(src->compactdata);
+				gl->compactdata = xmalloc(size);
+				memcpy(gl->compactdata, src->compactdata, size);
+				gl->cellsize = src->cellsize;
+				grid_memory_add(gd, size);
+			}
+		}
+
+		gd->coldsize -= n;
+		grid_block_free(gb);
+		if (--gd->nblocks == 0)
+			gd->coldoff = 0;
+	}
+	return (0);
 }
 
 /*
  * Scroll the entire visible screen, moving one line into the history. Just
- * allocate a new line at the bottom and move the history size indicator.
+ * make room for a new line at the bottom and move the history size indicator.
  */
 void
 grid_scroll_history(struct grid *gd)
@@ -177,87 +1172,96 @@ grid_scroll_history(struct grid *gd)
 	GRID_DEBUG(gd, "");
 
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xrealloc(gd->linedata, yy + 1, sizeof *gd->linedata);
-	memset(&gd->linedata[yy], 0, sizeof gd->linedata[yy]);
+	grid_reserve_lines(gd, yy + 1);
+	memset(grid_line(gd, yy), 0, sizeof *gd->linedata);
 
+	grid_compact_line(gd, gd->hsize);
 	gd->hsize++;
+
+	grid_freeze_history(gd);
 }
 
-/* Scroll a region up, moving the top line into the history. */
+/*
+ * Scroll a region up, moving the top line into the history. Only the lines
+ * outside the region need to be moved: the lines above it are shifted down
+ * one to make room for the line going into the history and the lines below it
+ * are shifted down over the new empty line at the bottom.
+ */
 void
 grid_scroll_history_region(struct grid *gd, u_int upper, u_int lower)
 {
-	struct grid_line	*gl_history, *gl_upper, *gl_lower;
+	struct grid_line	 gl_history;
 	u_int			 yy;
 
 	GRID_DEBUG(gd, "upper=%u, lower=%u", upper, lower);
 
 	/* Create a space for a new line. */
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xrealloc(gd->linedata, yy + 1, sizeof *gd->linedata);
-
-	/* Move the entire screen down to free a space for this line. */
-	gl_history = &gd->linedata[gd->hsize];
-	memmove(gl_history + 1, gl_history, gd->sy * sizeof *gl_history);
+	grid_reserve_lines(gd, yy + 1);
 
-	/* Adjust the region and find its start and end. */
-	upper++;
-	gl_upper = &gd->linedata[upper];
-	lower++;
-	gl_lower = &gd->linedata[lower];
+	/* Take out the top line of the region and move the lines above down. */
+	memcpy(&gl_history, grid_line(gd, upper), sizeof gl_history);
+	for (yy = upper; yy > gd->hsize; yy--) {
+		memcpy(grid_line(gd, yy),
+		    grid_line(gd, yy - 1), sizeof *gd->linedata);
+	}
 
 	/* Move the line into the history. */
-	memcpy(gl_history, gl_upper, sizeof *gl_history);
+	memcpy(grid_line(gd, gd->hsize), &gl_history, sizeof gl_history);
+	grid_compact_line(gd, gd->hsize);
 
-	/* Then move the region up and clear the bottom line. */
-	memmove(gl_upper, gl_upper + 1, (lower - upper) * sizeof *gl_upper);
-	memset(gl_lower, 0, sizeof *gl_lower);
+	/* Move the lines below the region down and clear the bottom line. */
+	for (yy = gd->hsize + gd->sy; yy > lower + 1; yy--) {
+		memcpy(grid_line(gd, yy),
+		    grid_line(gd, yy - 1), sizeof *gd->linedata);
+	}
+	memset(grid_line(gd, lower + 1), 0, sizeof *gd->linedata);
 
 	/* Move the history offset down over the line. */
 	gd->hsize++;
+
+	grid_freeze_history(gd);
 }
 
-/* Expand line to fit to cell. */
-void
+/* Expand line to fit to cell. Returns -1 if the line cannot be changed. */
+int
 grid_expand_line(struct grid *gd, u_int py, u_int sx)
 {
 	struct grid_line	*gl;
 	u_int			 xx;
 
-	gl = &gd->linedata[py];
+	if (grid_inflate_line(gd, py) != 0)
+		return (-1);
+
+	gl = grid_line(gd, py);
 	if (sx <= gl->cellsize)
-		return;
+		return (0);
 
 	gl->celldata = xrealloc(gl->celldata, sx, sizeof *gl->celldata);
+	grid_memory_add(gd, (sx - gl->cellsize) * sizeof *gl->celldata);
 	for (xx = gl->cellsize; xx < sx; xx++)
 		grid_put_cell(gd, xx, py, &grid_default_cell);
 	gl->cellsize = sx;
-}
-
-/* Expand line to fit to cell for UTF-8. */
-void
-grid_expand_line_utf8(struct grid *gd, u_int py, u_int sx)
-{
-	struct grid_line	*gl;
-
-	gl = &gd->linedata[py];
-	if (sx <= gl->utf8size)
-		return;
-
-	gl->utf8data = xrealloc(gl->utf8data, sx, sizeof *gl->utf8data);
-	gl->utf8size = sx;
+	return (0);
 }
 
 /* Get cell for reading. */
 const struct grid_cell *
 grid_peek_cell(struct grid *gd, u_int px, u_int py)
 {
+	struct grid_line	*gl;
+
 	if (grid_check_y(gd, py) != 0)
 		return (&grid_default_cell);
 
-	if (px >= gd->linedata[py].cellsize)
+	gl = grid_line(gd, py);
+	if (px >= gl->cellsize)
 		return (&grid_default_cell);
-	return (&gd->linedata[py].celldata[px]);
+	if (gl->compactdata != NULL) {
+		grid_cache_line(gd, gl);
+		return (&gd->cachecells[px]);
+	}
+	return (&gl->celldata[px]);
 }
 
 /* Get cell at relative position (for writing). */
@@ -267,8 +1271,9 @@ grid_get_cell(struct grid *gd, u_int px, u_int py)
 	if (grid_check_y(gd, py) != 0)
 		return (NULL);
 
-	grid_expand_line(gd, py, px + 1);
-	return (&gd->linedata[py].celldata[px]);
+	if (grid_expand_line(gd, py, px + 1) != 0)
+		return (NULL);
+	return (&grid_line(gd, py)->celldata[px]);
 }
 
 /* Set cell at relative position. */
@@ -279,50 +1284,62 @@ grid_set_cell(
 	if (grid_check_y(gd, py) != 0)
 		return;
 
-	grid_expand_line(gd, py, px + 1);
+	if (grid_expand_line(gd, py, px + 1) != 0)
+		return;
 	grid_put_cell(gd, px, py, gc);
 }
 
-/* Get UTF-8 for reading. */
-const struct grid_utf8 *
-grid_peek_utf8(struct grid *gd, u_int px, u_int py)
+/* Set a run of cells with the same attributes from a string of characters. */
+void
+grid_set_cells(struct grid *gd, u_int px, u_int py, const struct grid_cell *gc,
+    const u_char *s, u_int n)
 {
+	struct grid_cell	*gce;
+	u_int			 xx;
+
 	if (grid_check_y(gd, py) != 0)
-		return (NULL);
+		return;
 
-	if (px >= gd->linedata[py].utf8size)
-		return (NULL);
-	return (&gd->linedata[py].utf8data[px]);
+	if (grid_expand_line(gd, py, px + n) != 0)
+		return;
+	gce = &grid_line(gd, py)->celldata[px];
+	for (xx = 0; xx < n; xx++) {
+		memcpy(&gce[xx], gc, sizeof gce[xx]);
+		gce[xx].data = s[xx];
+	}
 }
 
-/* Get utf8 at relative position (for writing). */
-struct grid_utf8 *
-grid_get_utf8(struct grid *gd, u_int px, u_int py)
+/* Get UTF-8 for reading. */
+const struct grid_utf8 *
+grid_peek_utf8(struct grid *gd, u_int px, u_int py)
 {
-	if (grid_check_y(gd, py) != 0)
-		return (NULL);
+	const struct grid_cell	*gc;
 
-	grid_expand_line_utf8(gd, py, px + 1);
-	return (&gd->linedata[py].utf8data[px]);
+	gc = grid_peek_cell(gd, px, py);
+	if (!(gc->flags & GRID_FLAG_UTF8))
+		return (NULL);
+	return (grid_utf8_get(gc->data));
 }
 
-/* Set utf8 at relative position. */
+/* Set UTF-8 at relative position. The cell must already be UTF-8. */
 void
 grid_set_utf8(
-    struct grid *gd, u_int px, u_int py, const struct grid_utf8 *gc)
+    struct grid *gd, u_int px, u_int py, const struct grid_utf8 *gu)
 {
 	if (grid_check_y(gd, py) != 0)
 		return;
 
-	grid_expand_line_utf8(gd, py, px + 1);
-	grid_put_utf8(gd, px, py, gc);
+	if (grid_expand_line(gd, py, px + 1) != 0)
+		return;
+	grid_line(gd, py)->celldata[px].data = grid_utf8_add(gu);
 }
 
 /* Clear area. */
 void
 grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny)
 {
-	u_int	xx, yy;
+	struct grid_line	*gl;
+	u_int			 xx, yy;
 
 	GRID_DEBUG(gd, "px=%u, py=%u, nx=%u, ny=%u", px, py, nx, ny);
 
@@ -340,14 +1357,20 @@ grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny)
 		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		if (px >= gd->linedata[yy].cellsize)
+		gl = grid_line(gd, yy);
+		if (px >= gl->cellsize)
+			continue;
+		if (grid_inflate_line(gd, yy) != 0)
 			continue;
-		if (px + nx >= gd->linedata[yy].cellsize) {
-			gd->linedata[yy].cellsize = px;
+		gl = grid_line(gd, yy);
+		if (px + nx >= gl->cellsize) {
+			grid_memory_sub(gd,
+			    (gl->cellsize - px) * sizeof *gl->celldata);
+			gl->cellsize = px;
 			continue;
 		}
 		for (xx = px; xx < px + nx; xx++) {
-			if (xx >= gd->linedata[yy].cellsize)
+			if (xx >= gl->cellsize)
 				break;
 			grid_put_cell(gd, xx, yy, &grid_default_cell);
 		}
@@ -370,13 +1393,18 @@ grid_clear_lines(struct grid *gd, u_int py, u_int ny)
 		return;
 	if (grid_check_y(gd, py + ny - 1) != 0)
 		return;
+	if (grid_thaw_lines(gd, py) != 0)
+		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
-		if (gl->celldata != NULL)
+		gl = grid_line(gd, yy);
+		if (gl->celldata != NULL) {
+			grid_memory_sub(gd,
+			    gl->cellsize * sizeof *gl->celldata);
 			xfree(gl->celldata);
-		if (gl->utf8data != NULL)
-			xfree(gl->utf8data);
+		}
+		if (gl->compactdata != NULL)
+			grid_compact_free(gd, gl);
 		memset(gl, 0, sizeof *gl);
 	}
 }
@@ -400,6 +1428,8 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny)
 		return;
 	if (grid_check_y(gd, dy + ny - 1) != 0)
 		return;
+	if (grid_thaw_lines(gd, dy < py ? dy : py) != 0)
+		return;
 
 	/* Free any lines which are being replaced. */
 	for (yy = dy; yy < dy + ny; yy++) {
@@ -408,14 +1438,24 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny)
 		grid_clear_lines(gd, yy, 1);
 	}
 
-	memmove(
-	    &gd->linedata[dy], &gd->linedata[py], ny * (sizeof *gd->linedata));
+	/* Copy the lines in the right order in case they overlap. */
+	if (dy < py) {
+		for (yy = 0; yy < ny; yy++) {
+			memcpy(grid_line(gd, dy + yy),
+			    grid_line(gd, py + yy), sizeof *gd->linedata);
+		}
+	} else {
+		for (yy = ny; yy > 0; yy--) {
+			memcpy(grid_line(gd, dy + yy - 1),
+			    grid_line(gd, py + yy - 1), sizeof *gd->linedata);
+		}
+	}
 
 	/* Wipe any lines that have been moved (without freeing them). */
 	for (yy = py; yy < py + ny; yy++) {
 		if (yy >= dy && yy < dy + ny)
 			continue;
-		memset(&gd->linedata[yy], 0, sizeof gd->linedata[yy]);
+		memset(grid_line(gd, yy), 0, sizeof *gd->linedata);
 	}
 }
 
@@ -433,20 +1473,15 @@ grid_move_cells(struct grid *gd, u_int dx, u_int px, u_int py, u_int nx)
 
 	if (grid_check_y(gd, py) != 0)
 		return;
-	gl = &gd->linedata[py];
 
-	grid_expand_line(gd, py, px + nx);
-	grid_expand_line(gd, py, dx + nx);
+	if (grid_expand_line(gd, py, px + nx) != 0)
+		return;
+	if (grid_expand_line(gd, py, dx + nx) != 0)
+		return;
+	gl = grid_line(gd, py);
 	memmove(
 	    &gl->celldata[dx], &gl->celldata[px], nx * sizeof *gl->celldata);
 
-	if (gl->utf8data != NULL) {
-		grid_expand_line_utf8(gd, py, px + nx);
-		grid_expand_line_utf8(gd, py, dx + nx);
-		memmove(&gl->utf8data[dx],
-		    &gl->utf8data[px], nx * sizeof *gl->utf8data);
-	}
-
 	/* Wipe any cells that have been moved. */
 	for (xx = px; xx < px + nx; xx++) {
 		if (xx >= dx && xx < dx + nx)
@@ -523,22 +1558,68 @@ grid_duplicate_lines(
 	grid_clear_lines(dst, dy, ny);
 
 	for (yy = 0; yy < ny; yy++) {
-		srcl = &src->linedata[sy];
-		dstl = &dst->linedata[dy];
+		srcl = grid_line(src, sy);
+		dstl = grid_line(dst, dy);
 
 		memcpy(dstl, srcl, sizeof *dstl);
-		if (srcl->cellsize != 0) {
+		if (srcl->compactdata != NULL) {
+			dstl->compactdata = xmalloc(
+			    grid_compact_size(srcl->compactdata));
+			memcpy(dstl->compactdata, srcl->compactdata,
+			    grid_compact_size(srcl->compactdata));
+		} else if (srcl->cellsize != 0) {
 			dstl->celldata = xcalloc(
 			    srcl->cellsize, sizeof *dstl->celldata);
 			memcpy(dstl->celldata, srcl->celldata,
 			    srcl->cellsize * sizeof *dstl->celldata);
 		}
-		if (srcl->utf8size != 0) {
-			dstl->utf8data = xcalloc(
-			    srcl->utf8size, sizeof *dstl->utf8data);
-			memcpy(dstl->utf8data, srcl->utf8data,
-			    srcl->utf8size * sizeof *dstl->utf8data);
-		}
+		grid_memory_add(dst, grid_line_memory(dstl));
+
+		sy++;
+		dy++;
+	}
+}
+
+/*
+ * Move a set of lines from one grid to another without copying them. The
+ * lines are left empty in the source grid. As with grid_duplicate_lines, the
+ * number of lines is limited to the number available.
+ */
+void
+grid_transfer_lines(
+    struct grid *dst, u_int dy, struct grid *src, u_int sy, u_int ny)
+{
+	struct grid_line	*dstl, *srcl;
+	size_t			 size;
+	u_int			 yy;
+
+	GRID_DEBUG(src, "dy=%u, sy=%u, ny=%u", dy, sy, ny);
+
+	if (dy + ny > dst->hsize + dst->sy)
+		ny = dst->hsize + dst->sy - dy;
+	if (sy + ny > src->hsize + src->sy)
+		ny = src->hsize + src->sy - sy;
+	if (ny == 0)
+		return;
+	grid_clear_lines(dst, dy, ny);
+	if (grid_thaw_lines(src, sy) != 0)
+		return;
+
+	for (yy = 0; yy < ny; yy++) {
+		srcl = grid_line(src, sy);
+		dstl = grid_line(dst, dy);
+
+		/* Do not leave the source cache pointing at the line. */
+		if (srcl->compactdata != NULL &&
+		    srcl->compactdata == src->cachesrc)
+			src->cachesrc = NULL;
+
+		size = grid_line_memory(srcl);
+		grid_memory_sub(src, size);
+		grid_memory_add(dst, size);
+
+		memcpy(dstl, srcl, sizeof *dstl);
+		memset(srcl, 0, sizeof *srcl);
 
 		sy++;
 		dy++;
@@ -52,6 +52,7 @@ int	input_split(struct input_ctx *);
 int	input_get(struct input_ctx *, u_int, int, int);
 void	input_reply(struct input_ctx *, const char *, ...);
 void	input_set_state(struct window_pane *, const struct input_transition *);
+void	input_build_lookup(void);
 
 /* Transition entry/exit handlers. */
 void	input_clear(struct input_ctx *);
@@ -200,6 +201,9 @@ struct input_state {
 	void				(*enter)(struct input_ctx *);
 	void				(*exit)(struct input_ctx *);
 	const struct input_transition	*transitions;
+
+	/* Transition for each byte, built from the table at startup. */
+	const struct input_transition	*lookup[256];
 };
 
 /* State transitions available from all states. */
@@ -231,143 +235,188 @@ const struct input_transition input_state_utf8_two_table[];
 const struct input_transition input_state_utf8_one_table[];
 
 /* ground state definition. */
-const struct input_state input_state_ground = {
+struct input_state input_state_ground = {
 	"ground",
 	NULL, NULL,
-	input_state_ground_table
+	input_state_ground_table,
+	{ NULL }
 };
 
 /* esc_enter state definition. */
-const struct input_state input_state_esc_enter = {
+struct input_state input_state_esc_enter = {
 	"esc_enter",
 	input_clear, NULL,
-	input_state_esc_enter_table
+	input_state_esc_enter_table,
+	{ NULL }
 };
 
 /* esc_intermediate state definition. */
-const struct input_state input_state_esc_intermediate = {
+struct input_state input_state_esc_intermediate = {
 	"esc_intermediate",
 	NULL, NULL,
-	input_state_esc_intermediate_table
+	input_state_esc_intermediate_table,
+	{ NULL }
 };
 
 /* csi_enter state definition. */
-const struct input_state input_state_csi_enter = {
+struct input_state input_state_csi_enter = {
 	"csi_enter",
 	input_clear, NULL,
-	input_state_csi_enter_table
+	input_state_csi_enter_table,
+	{ NULL }
 };
 
 /* csi_parameter state definition. */
-const struct input_state input_state_csi_parameter = {
+struct input_state input_state_csi_parameter = {
 	"csi_parameter",
 	NULL, NULL,
-	input_state_csi_parameter_table
+	input_state_csi_parameter_table,
+	{ NULL }
 };
 
 /* csi_intermediate state definition. */
-const struct input_state input_state_csi_intermediate = {
+struct input_state input_state_csi_intermediate = {
 	"csi_intermediate",
 	NULL, NULL,
-	input_state_csi_intermediate_table
+	input_state_csi_intermediate_table,
+	{ NULL }
 };
 
 /* csi_ignore state definition. */
-const struct input_state input_state_csi_ignore = {
+struct input_state input_state_csi_ignore = {
 	"csi_ignore",
 	NULL, NULL,
-	input_state_csi_ignore_table
+	input_state_csi_ignore_table,
+	{ NULL }
 };
 
 /* dcs_enter state definition. */
-const struct input_state input_state_dcs_enter = {
+struct input_state input_state_dcs_enter = {
 	"dcs_enter",
 	input_clear, NULL,
-	input_state_dcs_enter_table
+	input_state_dcs_enter_table,
+	{ NULL }
 };
 
 /* dcs_parameter state definition. */
-const struct input_state input_state_dcs_parameter = {
+struct input_state input_state_dcs_parameter = {
 	"dcs_parameter",
 	NULL, NULL,
-	input_state_dcs_parameter_table
+	input_state_dcs_parameter_table,
+	{ NULL }
 };
 
 /* dcs_intermediate state definition. */
-const struct input_state input_state_dcs_intermediate = {
+struct input_state input_state_dcs_intermediate = {
 	"dcs_intermediate",
 	NULL, NULL,
-	input_state_dcs_intermediate_table
+	input_state_dcs_intermediate_table,
+	{ NULL }
 };
 
 /* dcs_handler state definition. */
-const struct input_state input_state_dcs_handler = {
+struct input_state input_state_dcs_handler = {
 	"dcs_handler",
 	NULL, NULL,
-	input_state_dcs_handler_table
+	input_state_dcs_handler_table,
+	{ NULL }
 };
 
 /* dcs_escape state definition. */
-const struct input_state input_state_dcs_escape = {
+struct input_state input_state_dcs_escape = {
 	"dcs_escape",
 	NULL, NULL,
-	input_state_dcs_escape_table
+	input_state_dcs_escape_table,
+	{ NULL }
 };
 
 /* dcs_ignore state definition. */
-const struct input_state input_state_dcs_ignore = {
+struct input_state input_state_dcs_ignore = {
 	"dcs_ignore",
 	NULL, NULL,
-	input_state_dcs_ignore_table
+	input_state_dcs_ignore_table,
+	{ NULL }
 };
 
 /* osc_string state definition. */
-const struct input_state input_state_osc_string = {
+struct input_state input_state_osc_string = {
 	"osc_string",
 	input_enter_osc, input_exit_osc,
-	input_state_osc_string_table
+	input_state_osc_string_table,
+	{ NULL }
 };
 
 /* apc_string state definition. */
-const struct input_state input_state_apc_string = {
+struct input_state input_state_apc_string = {
 	"apc_string",
 	input_enter_apc, input_exit_apc,
-	input_state_apc_string_table
+	input_state_apc_string_table,
+	{ NULL }
 };
 
 /* rename_string state definition. */
-const struct input_state input_state_rename_string = {
+struct input_state input_state_rename_string = {
 	"rename_string",
 	input_enter_rename, input_exit_rename,
-	input_state_rename_string_table
+	input_state_rename_string_table,
+	{ NULL }
 };
 
 /* consume_st state definition. */
-const struct input_state input_state_consume_st = {
+struct input_state input_state_consume_st = {
 	"consume_st",
 	NULL, NULL,
-	input_state_consume_st_table
+	input_state_consume_st_table,
+	{ NULL }
 };
 
 /* utf8_three state definition. */
-const struct input_state input_state_utf8_three = {
+struct input_state input_state_utf8_three = {
 	"utf8_three",
 	NULL, NULL,
-	input_state_utf8_three_table
+	input_state_utf8_three_table,
+	{ NULL }
 };
 
 /* utf8_two state definition. */
-const struct input_state input_state_utf8_two = {
+struct input_state input_state_utf8_two = {
 	"utf8_two",
 	NULL, NULL,
-	input_state_utf8_two_table
+	input_state_utf8_two_table,
+	{ NULL }
 };
 
 /* utf8_one state definition. */
-const struct input_state input_state_utf8_one = {
+struct input_state input_state_utf8_one = {
 	"utf8_one",
 	NULL, NULL,
-	input_state_utf8_one_table
+	input_state_utf8_one_table,
+	{ NULL }
+};
+
+/* All states, for building the lookup tables. */
+struct input_state *input_states[] = {
+	&input_state_ground,
+	&input_state_esc_enter,
+	&input_state_esc_intermediate,
+	&input_state_csi_enter,
+	&input_state_csi_parameter,
+	&input_state_csi_intermediate,
+	&input_state_csi_ignore,
+	&input_state_dcs_enter,
+	&input_state_dcs_parameter,
+	&input_state_dcs_intermediate,
+	&input_state_dcs_handler,
+	&input_state_dcs_escape,
+	&input_state_dcs_ignore,
+	&input_state_osc_string,
+	&input_state_apc_string,
+	&input_state_rename_string,
+	&input_state_consume_st,
+	&input_state_utf8_three,
+	&input_state_utf8_two,
+	&input_state_utf8_one,
+	NULL
 };
 
 /* ground state table. */
@@ -674,12 +723,41 @@ input_table_compare(const void *key, const void *value)
 	return (strcmp(ictx->interm_buf, entry->interm));
 }
 
+/*
+ * Build the lookup table for each state from its transitions. The first
+ * matching transition wins, as when the table was searched.
+ */
+void
+input_build_lookup(void)
+{
+	struct input_state		**st, *state;
+	const struct input_transition	 *itr;
+	int				  ch;
+
+	for (st = input_states; *st != NULL; st++) {
+		state = *st;
+		for (itr = state->transitions; itr->first != -1; itr++) {
+			for (ch = itr->first; ch <= itr->last; ch++) {
+				if (state->lookup[ch] == NULL)
+					state->lookup[ch] = itr;
+			}
+		}
+		for (ch = 0; ch < 256; ch++) {
+			if (state->lookup[ch] == NULL)
+				fatalx("no transition from state");
+		}
+	}
+}
+
 /* Initialise input parser. */
 void
 input_init(struct window_pane *wp)
 {
 	struct input_ctx	*ictx = &wp->ictx;
 
+	if (input_state_ground.lookup[0] == NULL)
+		input_build_lookup();
+
 	memcpy(&ictx->cell, &grid_default_cell, sizeof ictx->cell);
 
 	memcpy(&ictx->old_cell, &grid_default_cell, sizeof ictx->old_cell);
@@ -724,21 +802,32 @@ input_set_state(struct window_pane *wp, const struct input_transition *itr)
 		ictx->state->enter(ictx);
 }
 
-/* Parse input. */
+/* Parse input from the pane's buffer. */
 void
 input_parse(struct window_pane *wp)
+{
+	struct evbuffer	*evb = wp->event->input;
+	size_t		 len;
+
+	if ((len = EVBUFFER_LENGTH(evb)) == 0)
+		return;
+	input_parse_buffer(wp, EVBUFFER_DATA(evb), len);
+	evbuffer_drain(evb, len);
+}
+
+/* Parse input from a buffer. */
+void
+input_parse_buffer(struct window_pane *wp, const u_char *buf, size_t len)
 {
 	struct input_ctx		*ictx = &wp->ictx;
 	const struct input_transition	*itr;
-	struct evbuffer			*evb = wp->event->input;
-	u_char				*buf;
-	size_t				 len, off;
+	size_t				 off, end;
 
-	if (EVBUFFER_LENGTH(evb) == 0)
+	if (len == 0)
 		return;
 
-	wp->window->flags |= WINDOW_ACTIVITY;
 	wp->window->flags &= ~WINDOW_SILENCE;
+	server_window_alert(wp->window, WINDOW_ACTIVITY);
 
 	/*
 	 * Open the screen. Use NULL wp if there is a mode set as don't want to
@@ -750,27 +839,32 @@ input_parse(struct window_pane *wp)
 		screen_write_start(&ictx->ctx, NULL, &wp->base);
 	ictx->wp = wp;
 
-	buf = EVBUFFER_DATA(evb);
-	len = EVBUFFER_LENGTH(evb);
 	off = 0;
+	log_debug("%s: %zu bytes, %s", __func__, len, ictx->state->name);
 
 	/* Parse the input. */
 	while (off < len) {
-		ictx->ch = buf[off++];
-		log_debug("%s: '%c' %s", __func__, ictx->ch, ictx->state->name);
-
-		/* Find the transition. */
-		itr = ictx->state->transitions;
-		while (itr->first != -1 && itr->last != -1) {
-			if (ictx->ch >= itr->first && ictx->ch <= itr->last)
-				break;
-			itr++;
-		}
-		if (itr->first == -1 || itr->last == -1) {
-			/* No transition? Eh? */
-			fatalx("No transition from state!");
+		/*
+		 * In the ground state, write a run of printable characters in
+		 * one go rather than one at a time.
+		 */
+		if (ictx->state == &input_state_ground) {
+			for (end = off; end < len; end++) {
+				if (buf[end] < 0x20 || buf[end] > 0x7e)
+					break;
+			}
+			if (end - off > 1) {
+				screen_write_cells(&ictx->ctx,
+				    &ictx->cell, buf + off, end - off);
+				ictx->ch = buf[end - 1];
+				off = end;
+				continue;
+			}
 		}
 
+		ictx->ch = buf[off++];
+		itr = ictx->state->lookup[ictx->ch];
+
 		/*
 		 * Execute the handler, if any. Don't switch state if it
 		 * returns non-zero.
@@ -789,8 +883,6 @@ input_parse(struct window_pane *wp)
 
 	/* Close the screen. */
 	screen_write_stop(&ictx->ctx);
-
-	evbuffer_drain(evb, len);
 }
 
 /* Split the parameter list (if any). */
@@ -931,7 +1023,6 @@ input_c0_dispatch(struct input_ctx *ictx)
 	struct screen_write_ctx	*sctx = &ictx->ctx;
 	struct window_pane	*wp = ictx->wp;
 	struct screen		*s = sctx->s;
-	u_int			 trigger;
 
 	log_debug("%s: '%c", __func__, ictx->ch);
 
@@ -939,11 +1030,11 @@ input_c0_dispatch(struct input_ctx *ictx)
 	case '\000':	/* NUL */
 		break;
 	case '\007':	/* BEL */
-		wp->window->flags |= WINDOW_BELL;
+		server_window_alert(wp->window, WINDOW_BELL);
 		break;
 	case '\010':	/* BS */
 		screen_write_backspace(sctx);
-		goto count_c0;
+		break;
 	case '\011':	/* HT */
 		/* Don't tab beyond the end of the line. */
 		if (s->cx >= screen_size_x(s) - 1)
@@ -960,10 +1051,10 @@ input_c0_dispatch(struct input_ctx *ictx)
 	case '\013':	/* VT */
 	case '\014':	/* FF */
 		screen_write_linefeed(sctx, 0);
-		goto count_c0;
+		break;
 	case '\015':	/* CR */
 		screen_write_carriagereturn(sctx);
-		goto count_c0;
+		break;
 	case '\016':	/* SO */
 		ictx->cell.attr |= GRID_ATTR_CHARSET;
 		break;
@@ -975,15 +1066,6 @@ input_c0_dispatch(struct input_ctx *ictx)
 		break;
 	}
 
-	return (0);
-
-count_c0:
-	trigger = options_get_number(&wp->window->options, "c0-change-trigger");
-	if (++wp->changes == trigger) {
-		wp->flags |= PANE_DROP;
-		window_pane_timer_start(wp);
-	}
-
 	return (0);
 }
 
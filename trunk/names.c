@@ -25,41 +25,131 @@
 
 #include "tmux.h"
 
+u_int	 window_name_slices(void);
+void	 window_name_start(void);
 void	 window_name_callback(unused int, unused short, void *);
+void	 window_name_update(struct window *);
+const char *window_name_command(struct window_pane *);
 char	*parse_window_name(const char *);
 
+/*
+ * Windows with automatic-rename on are kept on a single list and checked by
+ * one timer rather than each having its own. Each time the timer fires a
+ * slice of the list is checked and moved to the end. Small lists are done in
+ * one go; larger ones are spread over up to NAME_SLICES firings so that each
+ * window is still looked at roughly once every NAME_INTERVAL.
+ */
+TAILQ_HEAD(, window) names_windows = TAILQ_HEAD_INITIALIZER(names_windows);
+u_int		names_count;
+struct timer	names_timer;
+
+/* Work out how many slices to split the list into. */
+u_int
+window_name_slices(void)
+{
+	u_int	slices;
+
+	slices = (names_count + NAME_BATCH - 1) / NAME_BATCH;
+	if (slices == 0)
+		return (1);
+	if (slices > NAME_SLICES)
+		return (NAME_SLICES);
+	return (slices);
+}
+
+/* Start the timer if it is not already running. */
 void
-queue_window_name(struct window *w)
+window_name_start(void)
 {
-	struct timeval	tv;
+	if (timer_pending(&names_timer))
+		return;
+	timer_set(&names_timer, window_name_callback, NULL);
+	timer_add(&names_timer, NAME_INTERVAL / window_name_slices());
+}
 
-	tv.tv_sec = 0;
-	tv.tv_usec = NAME_INTERVAL * 1000L;
+/* Add a window to the list. */
+void
+queue_window_name(struct window *w)
+{
+	if (!(w->flags & WINDOW_NAMEQUEUED)) {
+		w->flags |= WINDOW_NAMEQUEUED;
+		TAILQ_INSERT_TAIL(&names_windows, w, names_entry);
+		names_count++;
+	}
+	window_name_start();
+}
 
-	if (event_initialized(&w->name_timer))
-		evtimer_del(&w->name_timer);
-	evtimer_set(&w->name_timer, window_name_callback, w);
-	evtimer_add(&w->name_timer, &tv);
+/* Take a window off the list. */
+void
+cancel_window_name(struct window *w)
+{
+	if (!(w->flags & WINDOW_NAMEQUEUED))
+		return;
+	w->flags &= ~WINDOW_NAMEQUEUED;
+	TAILQ_REMOVE(&names_windows, w, names_entry);
+	names_count--;
 }
 
 /* ARGSUSED */
 void
-window_name_callback(unused int fd, unused short events, void *data)
+window_name_callback(unused int fd, unused short events, unused void *data)
 {
-	struct window	*w = data;
-	char		*name, *wname;
-
-	if (!options_get_number(&w->options, "automatic-rename")) {
-		if (event_initialized(&w->name_timer))
-			event_del(&w->name_timer);
-		return;
+	struct window	*w;
+	u_int		 slices, n;
+
+	slices = window_name_slices();
+	n = (names_count + slices - 1) / slices;
+	while (n-- != 0 && (w = TAILQ_FIRST(&names_windows)) != NULL) {
+		cancel_window_name(w);
+		if (!options_get_number(&w->options, "automatic-rename"))
+			continue;
+		w->flags |= WINDOW_NAMEQUEUED;
+		TAILQ_INSERT_TAIL(&names_windows, w, names_entry);
+		names_count++;
+
+		window_name_update(w);
 	}
-	queue_window_name(w);
+
+	if (!TAILQ_EMPTY(&names_windows))
+		window_name_start();
+}
+
+/*
+ * Get the command running in a pane. Only the foreground process group is
+ * fetched each time; the command itself is looked up again only if that has
+ * changed or the saved command is old enough that the process may have
+ * called exec.
+ */
+const char *
+window_name_command(struct window_pane *wp)
+{
+	pid_t	pgrp;
+
+	if (wp->fd == -1 || (pgrp = tcgetpgrp(wp->fd)) == -1)
+		return (NULL);
+
+	if (pgrp == wp->name_pgrp && wp->name_age++ < NAME_REFRESH)
+		return (wp->name_cmd);
+
+	if (wp->name_cmd != NULL)
+		xfree(wp->name_cmd);
+	wp->name_cmd = osdep_get_name(wp->fd, wp->tty);
+	wp->name_pgrp = pgrp;
+	wp->name_age = 0;
+	return (wp->name_cmd);
+}
+
+/* Work out the name of a window and change it if it is different. */
+void
+window_name_update(struct window *w)
+{
+	const char	*name;
+	char		*wname, *dead;
 
 	if (w->active->screen != &w->active->base)
 		name = NULL;
 	else
-		name = osdep_get_name(w->active->fd, w->active->tty);
+		name = window_name_command(w->active);
 	if (name == NULL)
 		wname = default_window_name(w);
 	else {
@@ -69,17 +159,16 @@ window_name_callback(unused int fd, unused short events, void *data)
 		 * present. Ick.
 		 */
 		if (w->active->cmd != NULL && *w->active->cmd == '\0' &&
-		    name != NULL && name[0] == '-' && name[1] != '\0')
+		    name[0] == '-' && name[1] != '\0')
 			wname = parse_window_name(name + 1);
 		else
-				wname = parse_window_name(name);
-		xfree(name);
+			wname = parse_window_name(name);
 	}
 
 	if (w->active->fd == -1) {
-		xasprintf(&name, "%s[dead]", wname);
+		xasprintf(&dead, "%s[dead]", wname);
 		xfree(wname);
-		wname = name;
+		wname = dead;
 	}
 
 	if (strcmp(wname, w->name)) {
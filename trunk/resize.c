@@ -31,116 +31,183 @@
  * So, when a client is resized or a session attached to or detached from a
  * client, the window sizes must be recalculated. For each session, find the
  * smallest client it is attached to, and resize it to that size. Then for
- * every window, find the smallest session it is attached to, resize it to that
- * size and clear and redraw every client with it as the current window.
+ * every window which may have changed, find the smallest session it is
+ * attached to, resize it to that size and clear and redraw every client with
+ * it as the current window.
  *
- * This is quite inefficient - better/additional data structures are needed
- * to make it better.
+ * A window may have changed if it is in a session whose size has changed, if
+ * it has been linked into or unlinked from a session or, for
+ * aggressive-resize, if it has become or stopped being the current window.
+ * These are queued and only those windows are looked at, using the list of
+ * winlinks in each window rather than searching every session.
  *
  * As a side effect, this function updates the SESSION_UNATTACHED flag. This
  * flag is necessary to make sure unattached sessions do not limit the size of
  * windows that are attached both to them and to other (attached) sessions.
  */
 
+void	recalculate_session_size(struct session *);
+void	recalculate_window_size(struct window *);
+
+/* Windows whose size needs to be worked out again. */
+TAILQ_HEAD(, window) resize_windows = TAILQ_HEAD_INITIALIZER(resize_windows);
+
+/* Queue a window to be looked at next time sizes are recalculated. */
+void
+resize_queue_window(struct window *w)
+{
+	if (w->flags & WINDOW_RESIZEQUEUED)
+		return;
+	w->flags |= WINDOW_RESIZEQUEUED;
+	TAILQ_INSERT_TAIL(&resize_windows, w, resize_entry);
+}
+
+/* Take a window off the queue. */
+void
+resize_cancel_window(struct window *w)
+{
+	if (!(w->flags & WINDOW_RESIZEQUEUED))
+		return;
+	w->flags &= ~WINDOW_RESIZEQUEUED;
+	TAILQ_REMOVE(&resize_windows, w, resize_entry);
+}
+
 void
 recalculate_sizes(void)
 {
 	struct session		*s;
 	struct client		*c;
 	struct window		*w;
-	struct window_pane	*wp;
-	u_int		 	 i, j, ssx, ssy, has, limit;
-	int		 	 flag;
-
-	RB_FOREACH(s, sessions, &sessions) {
-		ssx = ssy = UINT_MAX;
-		for (j = 0; j < ARRAY_LENGTH(&clients); j++) {
-			c = ARRAY_ITEM(&clients, j);
-			if (c == NULL || c->flags & CLIENT_SUSPENDED)
-				continue;
-			if (c->session == s) {
-				if (c->tty.sx < ssx)
-					ssx = c->tty.sx;
-				if (c->tty.sy < ssy)
-					ssy = c->tty.sy;
-			}
-		}
-		if (ssx == UINT_MAX || ssy == UINT_MAX) {
-			s->flags |= SESSION_UNATTACHED;
+	u_int		 	 i;
+
+	/* Find the smallest client for each session. */
+	RB_FOREACH(s, sessions, &sessions)
+		s->csx = s->csy = UINT_MAX;
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c == NULL || c->flags & CLIENT_SUSPENDED)
 			continue;
-		}
-		s->flags &= ~SESSION_UNATTACHED;
-
-		if (options_get_number(&s->options, "status")) {
-			if (ssy == 0)
-				ssy = 1;
-			else
-				ssy--;
-		}
-		if (s->sx == ssx && s->sy == ssy)
+		if ((s = c->session) == NULL)
 			continue;
+		if (c->tty.sx < s->csx)
+			s->csx = c->tty.sx;
+		if (c->tty.sy < s->csy)
+			s->csy = c->tty.sy;
+	}
+	RB_FOREACH(s, sessions, &sessions)
+		recalculate_session_size(s);
+
+	while ((w = TAILQ_FIRST(&resize_windows)) != NULL) {
+		resize_cancel_window(w);
+		recalculate_window_size(w);
+	}
+}
+
+/*
+ * Set the size of a session from its smallest client and queue its windows if
+ * anything has changed.
+ */
+void
+recalculate_session_size(struct session *s)
+{
+	struct winlink	*wl;
+	u_int		 ssx, ssy;
+	int		 changed;
+
+	ssx = s->csx;
+	ssy = s->csy;
+	if (ssx == UINT_MAX || ssy == UINT_MAX) {
+		if (s->flags & SESSION_UNATTACHED)
+			return;
+		s->flags |= SESSION_UNATTACHED;
+		RB_FOREACH(wl, winlinks, &s->windows)
+			resize_queue_window(wl->window);
+		return;
+	}
+	changed = s->flags & SESSION_UNATTACHED;
+	s->flags &= ~SESSION_UNATTACHED;
+
+	/* The current window matters to windows with aggressive-resize. */
+	if (s->curw != NULL && s->curw->window != s->sizew) {
+		if (s->sizew != NULL)
+			resize_queue_window(s->sizew);
+		s->sizew = s->curw->window;
+		resize_queue_window(s->sizew);
+	}
 
+	if (options_get_number(&s->options, "status")) {
+		if (ssy == 0)
+			ssy = 1;
+		else
+			ssy--;
+	}
+	if (s->sx != ssx || s->sy != ssy) {
 		log_debug(
 		    "session size %u,%u (was %u,%u)", ssx, ssy, s->sx, s->sy);
 
 		s->sx = ssx;
 		s->sy = ssy;
+		changed = 1;
 	}
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		w = ARRAY_ITEM(&windows, i);
-		if (w == NULL)
-			continue;
-		flag = options_get_number(&w->options, "aggressive-resize");
-
-		ssx = ssy = UINT_MAX;
-		RB_FOREACH(s, sessions, &sessions) {
-			if (s->flags & SESSION_UNATTACHED)
-				continue;
-			if (flag)
-				has = s->curw->window == w;
-			else
-				has = session_has(s, w) != NULL;
-			if (has) {
-				if (s->sx < ssx)
-					ssx = s->sx;
-				if (s->sy < ssy)
-					ssy = s->sy;
-			}
-		}
-		if (ssx == UINT_MAX || ssy == UINT_MAX)
-			continue;
+	if (changed) {
+		RB_FOREACH(wl, winlinks, &s->windows)
+			resize_queue_window(wl->window);
+	}
+}
+
+/* Set the size of a window from the smallest session it is in. */
+void
+recalculate_window_size(struct window *w)
+{
+	struct session		*s;
+	struct winlink		*wl;
+	struct window_pane	*wp;
+	u_int		 	 ssx, ssy, limit;
+	int		 	 flag;
 
-		limit = options_get_number(&w->options, "force-width");
-		if (limit != 0 && ssx > limit)
-			ssx = limit;
-		limit = options_get_number(&w->options, "force-height");
-		if (limit != 0 && ssy > limit)
-			ssy = limit;
+	flag = options_get_number(&w->options, "aggressive-resize");
 
-		if (w->sx == ssx && w->sy == ssy)
+	ssx = ssy = UINT_MAX;
+	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+		s = wl->session;
+		if (s->flags & SESSION_UNATTACHED)
 			continue;
-
-		log_debug(
-		    "window size %u,%u (was %u,%u)", ssx, ssy, w->sx, w->sy);
-
-		layout_resize(w, ssx, ssy);
-		window_resize(w, ssx, ssy);
-
-		/*
-		 * If the current pane is now not visible, move to the next
-		 * that is.
-		 */
-		wp = w->active;
-		while (!window_pane_visible(w->active)) {
-			w->active = TAILQ_PREV(w->active, window_panes, entry);
-			if (w->active == NULL)
-				w->active = TAILQ_LAST(&w->panes, window_panes);
-			if (w->active == wp)
-			       break;
-		}
-
-		server_redraw_window(w);
-		notify_window_layout_changed(w);
+		if (flag && s->curw->window != w)
+			continue;
+		if (s->sx < ssx)
+			ssx = s->sx;
+		if (s->sy < ssy)
+			ssy = s->sy;
 	}
+	if (ssx == UINT_MAX || ssy == UINT_MAX)
+		return;
+
+	limit = options_get_number(&w->options, "force-width");
+	if (limit != 0 && ssx > limit)
+		ssx = limit;
+	limit = options_get_number(&w->options, "force-height");
+	if (limit != 0 && ssy > limit)
+		ssy = limit;
+
+	if (w->sx == ssx && w->sy == ssy)
+		return;
+
+	log_debug("window size %u,%u (was %u,%u)", ssx, ssy, w->sx, w->sy);
+
+	layout_resize(w, ssx, ssy);
+	window_resize(w, ssx, ssy);
+
+	/* If the current pane is now not visible, move to the next that is. */
+	wp = w->active;
+	while (!window_pane_visible(w->active)) {
+		w->active = TAILQ_PREV(w->active, window_panes, entry);
+		if (w->active == NULL)
+			w->active = TAILQ_LAST(&w->panes, window_panes);
+		if (w->active == wp)
+		       break;
+	}
+
+	server_redraw_window(w);
+	notify_window_layout_changed(w);
 }
@@ -350,6 +350,7 @@ draw_text:
 		colour_set_fg(&gc, colour);
 	tty_attributes(tty, &gc);
 	tty_puts(tty, buf);
+	tty_invalidate(tty);
 
 	tty_cursor(tty, 0, 0);
 }
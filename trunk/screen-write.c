@@ -24,6 +24,8 @@
 
 void	screen_write_initctx(struct screen_write_ctx *, struct tty_ctx *, int);
 void	screen_write_overwrite(struct screen_write_ctx *, u_int);
+void	screen_write_span(struct screen_write_ctx *, u_int);
+void	screen_write_flush(struct screen_write_ctx *);
 int	screen_write_combine(
 	    struct screen_write_ctx *, const struct utf8_data *);
 
@@ -37,15 +39,57 @@ screen_write_start(
 		ctx->s = wp->screen;
 	else
 		ctx->s = s;
+
+	ctx->spanlen = 0;
 }
 
 /* Finish writing. */
-/* ARGSUSED */
 void
-screen_write_stop(unused struct screen_write_ctx *ctx)
+screen_write_stop(struct screen_write_ctx *ctx)
+{
+	screen_write_flush(ctx);
+}
+
+/*
+ * Add cells at the cursor to the span waiting to be drawn. If they do not
+ * follow on from the existing span, draw that first.
+ */
+void
+screen_write_span(struct screen_write_ctx *ctx, u_int n)
 {
+	struct screen	*s = ctx->s;
+
+	if (ctx->spanlen != 0 &&
+	    (s->cy != ctx->spany || s->cx != ctx->spanx + ctx->spanlen))
+		screen_write_flush(ctx);
+
+	if (ctx->spanlen == 0) {
+		ctx->spanx = s->cx;
+		ctx->spany = s->cy;
+	}
+	ctx->spanlen += n;
 }
 
+/* Draw the waiting span of cells, if any, from the grid. */
+void
+screen_write_flush(struct screen_write_ctx *ctx)
+{
+	struct screen	*s = ctx->s;
+	struct tty_ctx	 ttyctx;
+
+	if (ctx->spanlen == 0)
+		return;
+
+	ttyctx.num = ctx->spanlen;
+	ctx->spanlen = 0;
+
+	screen_write_initctx(ctx, &ttyctx, 0);
+	ttyctx.ocx = ctx->spanx;
+	ttyctx.ocy = ctx->spany;
+	ttyctx.cells = grid_view_peek_cell(s->grid, ctx->spanx, ctx->spany);
+
+	tty_write(tty_cmd_cells, &ttyctx);
+}
 
 /* Reset screen state. */
 void
@@ -378,8 +422,9 @@ screen_write_copy(struct screen_write_ctx *ctx,
 	cx = s->cx;
 	cy = s->cy;
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
 		if (yy < gd->hsize + gd->sy) {
+			gl = grid_get_line(gd, yy);
+
 			/*
 			 * Find start and end position and copy between
 			 * them. Limit to the real end of the line then use a
@@ -396,16 +441,13 @@ screen_write_copy(struct screen_write_ctx *ctx,
 				bx = px + nx;
 
 			for (xx = ax; xx < bx; xx++) {
-				if (xx >= gl->cellsize)
-					gc = &grid_default_cell;
-				else
-					gc = &gl->celldata[xx];
+				gc = grid_peek_cell(gd, xx, yy);
 				if (!(gc->flags & GRID_FLAG_UTF8)) {
 					screen_write_cell(ctx, gc, NULL);
 					continue;
 				}
 				/* Reinject the UTF-8 sequence. */
-				gu = &gl->utf8data[xx];
+				gu = grid_peek_utf8(gd, xx, yy);
 				utf8data.size = grid_utf8_copy(
 				    gu, utf8data.data, sizeof utf8data.data);
 				utf8data.width = gu->width;
@@ -431,6 +473,9 @@ screen_write_initctx(
 	const struct grid_utf8	*gu;
 	u_int			 xx;
 
+	/* Anything waiting must be drawn before this command. */
+	screen_write_flush(ctx);
+
 	ttyctx->wp = ctx->wp;
 
 	ttyctx->ocx = s->cx;
@@ -549,7 +594,7 @@ screen_write_backspace(struct screen_write_ctx *ctx)
 	if (s->cx == 0) {
 		if (s->cy == 0)
 			return;
-		gl = &s->grid->linedata[s->grid->hsize + s->cy - 1];
+		gl = grid_get_line(s->grid, s->grid->hsize + s->cy - 1);
 		if (gl->flags & GRID_LINE_WRAPPED) {
 			s->cy--;
 			s->cx = screen_size_x(s) - 1;
@@ -900,7 +945,7 @@ screen_write_linefeed(struct screen_write_ctx *ctx, int wrapped)
 
 	screen_write_initctx(ctx, &ttyctx, 0);
 
-	gl = &s->grid->linedata[s->grid->hsize + s->cy];
+	gl = grid_get_line(s->grid, s->grid->hsize + s->cy);
 	if (wrapped)
 		gl->flags |= GRID_LINE_WRAPPED;
 	else
@@ -1022,8 +1067,7 @@ screen_write_clearhistory(struct screen_write_ctx *ctx)
 	struct screen	*s = ctx->s;
 	struct grid	*gd = s->grid;
 
-	grid_move_lines(gd, 0, gd->hsize, gd->sy);
-	gd->hsize = 0;
+	grid_clear_history(gd);
 }
 
 /* Write cell data. */
@@ -1037,7 +1081,7 @@ screen_write_cell(struct screen_write_ctx *ctx,
 	struct grid_utf8	 gu;
 	u_int		 	 width, xx;
 	struct grid_cell 	 tmp_gc, *tmp_gcp;
-	int			 insert = 0;
+	int			 insert = 0, span;
 
 	/* Ignore padding. */
 	if (gc->flags & GRID_FLAG_PADDING)
@@ -1071,8 +1115,17 @@ screen_write_cell(struct screen_write_ctx *ctx,
 		return;
 	}
 
-	/* Initialise the redraw context, saving the last cell. */
-	screen_write_initctx(ctx, &ttyctx, 1);
+	/*
+	 * If the cell fits on the line and there is no insert mode or
+	 * selection to worry about, add it to the span to be drawn later.
+	 * Otherwise initialise the redraw context, saving the last cell.
+	 */
+	span = !(s->mode & MODE_INSERT) && !s->sel.flag &&
+	    s->cx <= screen_size_x(s) - width && s->cy < screen_size_y(s);
+	if (span)
+		screen_write_span(ctx, width);
+	else
+		screen_write_initctx(ctx, &ttyctx, 1);
 
 	/* If in insert mode, make space for the cells. */
 	if ((s->mode & MODE_INSERT) && s->cx <= screen_size_x(s) - width) {
@@ -1115,6 +1168,8 @@ screen_write_cell(struct screen_write_ctx *ctx,
 
 	/* Move the cursor. */
 	s->cx += width;
+	if (span)
+		return;
 
 	/* Draw to the screen if necessary. */
 	if (insert) {
@@ -1137,6 +1192,45 @@ screen_write_cell(struct screen_write_ctx *ctx,
 	}
 }
 
+/*
+ * Write a run of printable ASCII characters with the same attributes. As much
+ * as fits on the current line is put into the grid together and added to the
+ * span to be drawn. Anything needing more care (wrapping, insert mode or a
+ * selection) goes through screen_write_cell a character at a time.
+ */
+void
+screen_write_cells(struct screen_write_ctx *ctx, const struct grid_cell *gc,
+    const u_char *buf, u_int len)
+{
+	struct screen		*s = ctx->s;
+	struct grid		*gd = s->grid;
+	struct grid_cell	 tmp_gc;
+	u_int			 n;
+
+	while (len != 0) {
+		if (s->cx >= screen_size_x(s) || s->cy > screen_size_y(s) - 1 ||
+		    (s->mode & MODE_INSERT) || s->sel.flag) {
+			memcpy(&tmp_gc, gc, sizeof tmp_gc);
+			tmp_gc.data = *buf++;
+			screen_write_cell(ctx, &tmp_gc, NULL);
+			len--;
+			continue;
+		}
+
+		n = screen_size_x(s) - s->cx;
+		if (n > len)
+			n = len;
+
+		screen_write_span(ctx, n);
+		screen_write_overwrite(ctx, n);
+		grid_view_set_cells(gd, s->cx, s->cy, gc, buf, n);
+		s->cx += n;
+
+		buf += n;
+		len -= n;
+	}
+}
+
 /* Combine a UTF-8 zero-width character onto the previous. */
 int
 screen_write_combine(
@@ -1145,7 +1239,7 @@ screen_write_combine(
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
 	struct grid_cell	*gc;
-	struct grid_utf8	*gu, tmp_gu;
+	struct grid_utf8	 gu;
 	u_int			 i;
 
 	/* Can't combine if at 0. */
@@ -1156,33 +1250,32 @@ screen_write_combine(
 	if (utf8data->size == 0)
 		fatalx("UTF-8 data empty");
 
-	/* Retrieve the previous cell and convert to UTF-8 if not already. */
+	/* Retrieve the previous cell and its UTF-8 or convert it. */
 	gc = grid_view_get_cell(gd, s->cx - 1, s->cy);
 	if (!(gc->flags & GRID_FLAG_UTF8)) {
-		tmp_gu.data[0] = gc->data;
-		tmp_gu.data[1] = 0xff;
-		tmp_gu.width = 1;
-
-		grid_view_set_utf8(gd, s->cx - 1, s->cy, &tmp_gu);
-		gc->flags |= GRID_FLAG_UTF8;
-	}
+		gu.data[0] = gc->data;
+		gu.data[1] = 0xff;
+		gu.width = 1;
+	} else
+		memcpy(&gu, grid_utf8_get(gc->data), sizeof gu);
 
 	/* Append the current cell. */
-	gu = grid_view_get_utf8(gd, s->cx - 1, s->cy);
-	if (grid_utf8_append(gu, utf8data) != 0) {
+	if (grid_utf8_append(&gu, utf8data) != 0) {
 		/* Failed: scrap this character and replace with underscores. */
-		if (gu->width == 1) {
+		if (gu.width == 1) {
 			gc->data = '_';
 			gc->flags &= ~GRID_FLAG_UTF8;
-		} else {
-			for (i = 0; i < gu->width && i != sizeof gu->data; i++)
-				gu->data[i] = '_';
-			if (i != sizeof gu->data)
-				gu->data[i] = 0xff;
-			gu->width = i;
+			return (0);
 		}
+		for (i = 0; i < gu.width && i != sizeof gu.data; i++)
+			gu.data[i] = '_';
+		if (i != sizeof gu.data)
+			gu.data[i] = 0xff;
+		gu.width = i;
 	}
 
+	gc->flags |= GRID_FLAG_UTF8;
+	gc->data = grid_utf8_add(&gu);
 	return (0);
 }
 
@@ -171,11 +171,12 @@ void
 screen_resize_y(struct screen *s, u_int sy)
 {
 	struct grid	*gd = s->grid;
-	u_int		 needed, available, oldy, i;
+	u_int		 needed, available, pull, oldy, oldlines;
 
 	if (sy == 0)
 		fatalx("zero size");
 	oldy = screen_size_y(s);
+	oldlines = gd->hsize + oldy;
 
 	/*
 	 * When resizing:
@@ -218,31 +219,28 @@ screen_resize_y(struct screen *s, u_int sy)
 		s->cy -= needed;
 	}
 
+	/*
+	 * If the size is increasing, work out how many lines can be pulled out
+	 * of the history, if it is enabled. They must not be left in blocks, so
+	 * unpack them now while the line array still matches the old size. If
+	 * that fails, leave the history alone.
+	 */
+	pull = 0;
+	if (sy > oldy && gd->flags & GRID_HISTORY) {
+		pull = sy - oldy;
+		if (pull > gd->hsize)
+			pull = gd->hsize;
+		if (pull != 0 && grid_thaw_lines(gd, gd->hsize - pull) != 0)
+			pull = 0;
+	}
+
 	/* Resize line arrays. */
-	gd->linedata = xrealloc(
-	    gd->linedata, gd->hsize + sy, sizeof *gd->linedata);
+	grid_adjust_lines(gd, oldlines, gd->hsize + sy);
 
-	/* Size increasing. */
+	/* Size increasing. Pull lines out of the history. */
 	if (sy > oldy) {
-		needed = sy - oldy;
-
-		/*
-		 * Try to pull as much as possible out of the history, if is
-		 * is enabled.
-		 */
-		available = gd->hsize;
-		if (gd->flags & GRID_HISTORY && available > 0) {
-			if (available > needed)
-				available = needed;
-			gd->hsize -= available;
-			s->cy += available;
-		} else
-			available = 0;
-		needed -= available;
-
-		/* Then fill the rest in with blanks. */
-		for (i = gd->hsize + sy - needed; i < gd->hsize + sy; i++)
-			memset(&gd->linedata[i], 0, sizeof gd->linedata[i]);
+		gd->hsize -= pull;
+		s->cy += pull;
 	}
 
 	/* Set the new size, and reset the scroll region. */
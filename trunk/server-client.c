@@ -29,6 +29,7 @@
 void	server_client_check_mouse(struct client *, struct window_pane *,
 	    struct mouse_event *);
 void	server_client_repeat_timer(int, short, void *);
+void	server_client_frame_timer(int, short, void *);
 void	server_client_check_exit(struct client *);
 void	server_client_check_redraw(struct client *);
 void	server_client_set_title(struct client *);
@@ -44,6 +45,14 @@ void printflike2 server_client_msg_error(struct cmd_ctx *, const char *, ...);
 void printflike2 server_client_msg_print(struct cmd_ctx *, const char *, ...);
 void printflike2 server_client_msg_info(struct cmd_ctx *, const char *, ...);
 
+/* Clients with something to do in the next pass through the loop. */
+TAILQ_HEAD(, client) server_client_dirty_list =
+    TAILQ_HEAD_INITIALIZER(server_client_dirty_list);
+
+/* Windows with redraw flags to clear after the clients have been drawn. */
+TAILQ_HEAD(, window) server_client_redraw_list =
+    TAILQ_HEAD_INITIALIZER(server_client_redraw_list);
+
 /* Create a new client. */
 void
 server_client_create(int fd)
@@ -71,6 +80,7 @@ server_client_create(int fd)
 
 	c->session = NULL;
 	c->last_session = NULL;
+	c->window = NULL;
 	c->tty.sx = 80;
 	c->tty.sy = 24;
 
@@ -88,7 +98,8 @@ server_client_create(int fd)
 	c->last_mouse.b = MOUSE_UP;
 	c->last_mouse.x = c->last_mouse.y = -1;
 
-	evtimer_set(&c->repeat_timer, server_client_repeat_timer, c);
+	timer_set(&c->repeat_timer, server_client_repeat_timer, c);
+	timer_set(&c->frame_timer, server_client_frame_timer, c);
 
 	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
 		if (ARRAY_ITEM(&clients, i) == NULL) {
@@ -135,6 +146,13 @@ server_client_lost(struct client *c)
 	}
 	log_debug("lost client %d", c->ibuf.fd);
 
+	if (c->flags & CLIENT_DIRTY) {
+		TAILQ_REMOVE(&server_client_dirty_list, c, dirty_entry);
+		c->flags &= ~CLIENT_DIRTY;
+	}
+
+	server_client_set_window(c, NULL);
+
 	/*
 	 * If CLIENT_TERMINAL hasn't been set, then tty_init hasn't been called
 	 * and tty_free might close an unrelated fd.
@@ -153,15 +171,13 @@ server_client_lost(struct client *c)
 	if (c->title != NULL)
 		xfree(c->title);
 
-	evtimer_del(&c->repeat_timer);
-
-	if (event_initialized(&c->identify_timer))
-		evtimer_del(&c->identify_timer);
+	timer_del(&c->repeat_timer);
+	timer_del(&c->frame_timer);
+	timer_del(&c->identify_timer);
 
 	if (c->message_string != NULL)
 		xfree(c->message_string);
-	if (event_initialized (&c->message_timer))
-		evtimer_del(&c->message_timer);
+	timer_del(&c->message_timer);
 	for (i = 0; i < ARRAY_LENGTH(&c->message_log); i++) {
 		msg = &ARRAY_ITEM(&c->message_log, i);
 		xfree(msg->msg);
@@ -208,6 +224,7 @@ server_client_callback(int fd, short events, void *data)
 
 	if (c->flags & CLIENT_DEAD)
 		return;
+	server_client_dirty(c);
 
 	if (fd == c->ibuf.fd) {
 		if (events & EV_WRITE && msgbuf_write(&c->ibuf.w) < 0)
@@ -268,7 +285,7 @@ server_client_status_timer(void)
 		difference = tv.tv_sec - c->status_timer.tv_sec;
 		if (difference >= interval) {
 			status_update_jobs(c);
-			c->flags |= CLIENT_STATUS;
+			server_status_client(c);
 		}
 	}
 }
@@ -344,13 +361,15 @@ server_client_handle_key(struct client *c, int key)
 	struct session		*s;
 	struct window		*w;
 	struct window_pane	*wp;
-	struct timeval		 tv;
 	struct key_binding	*bd;
 	int		      	 xtimeout, isprefix;
 
 	/* Check the client is good to accept input. */
 	if ((c->flags & (CLIENT_DEAD|CLIENT_SUSPENDED)) != 0)
 		return;
+
+	/* A key can change what any client is showing. */
+	server_client_dirty_all();
 	if (c->session == NULL)
 		return;
 	s = c->session;
@@ -444,46 +463,65 @@ server_client_handle_key(struct client *c, int key)
 	xtimeout = options_get_number(&c->session->options, "repeat-time");
 	if (xtimeout != 0 && bd->can_repeat) {
 		c->flags |= CLIENT_PREFIX|CLIENT_REPEAT;
-
-		tv.tv_sec = xtimeout / 1000;
-		tv.tv_usec = (xtimeout % 1000) * 1000L;
-		evtimer_del(&c->repeat_timer);
-		evtimer_add(&c->repeat_timer, &tv);
+		timer_add(&c->repeat_timer, xtimeout);
 	}
 
 	/* Dispatch the command. */
 	key_bindings_dispatch(bd, c);
 }
 
-/* Client functions that need to happen every loop. */
+/*
+ * Client functions that need to happen every loop. Only clients which have been
+ * marked dirty since the last pass are looked at.
+ */
 void
 server_client_loop(void)
 {
 	struct client		*c;
 	struct window		*w;
 	struct window_pane	*wp;
-	u_int		 	 i;
+	TAILQ_HEAD(, client)	 loop;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL)
-			continue;
+	/*
+	 * Take the current list, so clients marked while this one is being
+	 * worked through are left for the next pass. Clients stay marked
+	 * until done so output while drawing doesn't queue them again.
+	 */
+	TAILQ_INIT(&loop);
+	while ((c = TAILQ_FIRST(&server_client_dirty_list)) != NULL) {
+		TAILQ_REMOVE(&server_client_dirty_list, c, dirty_entry);
+		TAILQ_INSERT_TAIL(&loop, c, dirty_entry);
+	}
+
+	while ((c = TAILQ_FIRST(&loop)) != NULL) {
+		TAILQ_REMOVE(&loop, c, dirty_entry);
 
 		server_client_check_exit(c);
+		c->flags &= ~CLIENT_FRAMEOPEN;
 		if (c->session != NULL) {
 			server_client_check_redraw(c);
 			server_client_reset_state(c);
 		}
+		tty_flush(&c->tty);
+
+		/*
+		 * Now the client has been redrawn, put it on the list for the
+		 * window it is showing.
+		 */
+		if (c->session != NULL && !(c->flags & CLIENT_SUSPENDED))
+			server_client_set_window(c, c->session->curw->window);
+		else
+			server_client_set_window(c, NULL);
+
+		c->flags &= ~CLIENT_DIRTY;
 	}
 
 	/*
 	 * Any windows will have been redrawn as part of clients, so clear
 	 * their flags now.
 	 */
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		w = ARRAY_ITEM(&windows, i);
-		if (w == NULL)
-			continue;
+	while ((w = TAILQ_FIRST(&server_client_redraw_list)) != NULL) {
+		server_client_cancel_redraw(w);
 
 		w->flags &= ~WINDOW_REDRAW;
 		TAILQ_FOREACH(wp, &w->panes, entry)
@@ -491,6 +529,77 @@ server_client_loop(void)
 	}
 }
 
+/* Mark a client as needing to be looked at in the next pass. */
+void
+server_client_dirty(struct client *c)
+{
+	if (c->flags & (CLIENT_DIRTY|CLIENT_DEAD))
+		return;
+	c->flags |= CLIENT_DIRTY;
+	TAILQ_INSERT_TAIL(&server_client_dirty_list, c, dirty_entry);
+}
+
+/* Mark every client, for when anything might have changed. */
+void
+server_client_dirty_all(void)
+{
+	struct client	*c;
+	u_int		 i;
+
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c != NULL)
+			server_client_dirty(c);
+	}
+}
+
+/* Mark the clients showing a window. */
+void
+server_client_dirty_window(struct window *w)
+{
+	struct client	*c;
+
+	TAILQ_FOREACH(c, &w->clients, window_entry)
+		server_client_dirty(c);
+}
+
+/* Queue a window to have its redraw flags cleared at the end of the loop. */
+void
+server_client_queue_redraw(struct window *w)
+{
+	if (w->flags & WINDOW_REDRAWQUEUED)
+		return;
+	w->flags |= WINDOW_REDRAWQUEUED;
+	TAILQ_INSERT_TAIL(&server_client_redraw_list, w, redraw_entry);
+}
+
+/* Take a window off the redraw queue. */
+void
+server_client_cancel_redraw(struct window *w)
+{
+	if (!(w->flags & WINDOW_REDRAWQUEUED))
+		return;
+	w->flags &= ~WINDOW_REDRAWQUEUED;
+	TAILQ_REMOVE(&server_client_redraw_list, w, redraw_entry);
+}
+
+/*
+ * Set the window the client's terminal is showing, so tty_write only needs
+ * to look at the clients on that window's list.
+ */
+void
+server_client_set_window(struct client *c, struct window *w)
+{
+	if (c->window == w)
+		return;
+
+	if (c->window != NULL)
+		TAILQ_REMOVE(&c->window->clients, c, window_entry);
+	c->window = w;
+	if (w != NULL)
+		TAILQ_INSERT_TAIL(&w->clients, c, window_entry);
+}
+
 /*
  * Update cursor position and mode settings. The scroll region and attributes
  * are cleared when idle (waiting for an event) as this is the most likely time
@@ -577,6 +686,61 @@ server_client_repeat_timer(unused int fd, unused short events, void *data)
 		c->flags &= ~(CLIENT_PREFIX|CLIENT_REPEAT);
 }
 
+/*
+ * Should an update to the client be held back? The first update after a
+ * quiet period is sent immediately and starts a frame, as is anything else
+ * in the same pass through the loop. Later updates before the frame is over
+ * are dropped and the client redrawn once at the end of it.
+ */
+int
+server_client_hold(struct client *c)
+{
+	struct timeval	tv, interval, next;
+	u_int		rate;
+
+	if (c->flags & CLIENT_FRAMEOPEN)
+		return (0);
+	if (c->flags & CLIENT_FRAMEWAIT)
+		return (1);
+
+	rate = options_get_number(&c->session->options, "frame-rate");
+	if (rate == 0)
+		return (0);
+	interval.tv_sec = 0;
+	interval.tv_usec = 1000000 / rate;
+
+	if (gettimeofday(&tv, NULL) != 0)
+		fatal("gettimeofday failed");
+	timeradd(&c->frame_last, &interval, &next);
+	if (!timercmp(&tv, &next, <)) {
+		memcpy(&c->frame_last, &tv, sizeof c->frame_last);
+		c->flags |= CLIENT_FRAMEOPEN;
+		server_client_dirty(c);
+		return (0);
+	}
+
+	/* Round up so the timer does not fire before the frame is over. */
+	timersub(&next, &tv, &interval);
+	timer_add(&c->frame_timer,
+	    interval.tv_sec * 1000 + (interval.tv_usec + 999) / 1000);
+	c->flags |= CLIENT_FRAMEWAIT;
+	return (1);
+}
+
+/* Frame timer callback. */
+/* ARGSUSED */
+void
+server_client_frame_timer(unused int fd, unused short events, void *data)
+{
+	struct client	*c = data;
+
+	c->flags &= ~CLIENT_FRAMEWAIT;
+	c->flags |= CLIENT_REDRAWWINDOW;
+	server_client_dirty(c);
+	if (gettimeofday(&c->frame_last, NULL) != 0)
+		fatal("gettimeofday failed");
+}
+
 /* Check if client should be exited. */
 void
 server_client_check_exit(struct client *c)
@@ -607,6 +771,10 @@ server_client_check_redraw(struct client *c)
 	struct window_pane	*wp;
 	int		 	 flags, redraw;
 
+	/* Leave the redraw until the terminal has caught up. */
+	if (c->tty.flags & TTY_BLOCK)
+		return;
+
 	flags = c->tty.flags & TTY_FREEZE;
 	c->tty.flags &= ~TTY_FREEZE;
 
@@ -91,12 +91,14 @@ void
 server_redraw_client(struct client *c)
 {
 	c->flags |= CLIENT_REDRAW;
+	server_client_dirty(c);
 }
 
 void
 server_status_client(struct client *c)
 {
 	c->flags |= CLIENT_STATUS;
+	server_client_dirty(c);
 }
 
 void
@@ -169,6 +171,7 @@ server_redraw_window(struct window *w)
 			server_redraw_client(c);
 	}
 	w->flags |= WINDOW_REDRAW;
+	server_client_queue_redraw(w);
 }
 
 void
@@ -181,11 +184,22 @@ server_redraw_window_borders(struct window *w)
 		c = ARRAY_ITEM(&clients, i);
 		if (c == NULL || c->session == NULL)
 			continue;
-		if (c->session->curw->window == w)
+		if (c->session->curw->window == w) {
 			c->flags |= CLIENT_BORDERS;
+			server_client_dirty(c);
+		}
 	}
 }
 
+/* Redraw a pane on the clients showing it at the end of this loop. */
+void
+server_redraw_pane(struct window_pane *wp)
+{
+	wp->flags |= PANE_REDRAW;
+	server_client_queue_redraw(wp->window);
+	server_client_dirty_window(wp->window);
+}
+
 void
 server_status_window(struct window *w)
 {
@@ -252,6 +266,7 @@ server_lock_client(struct client *c)
 	tty_raw(&c->tty, tty_term_string(c->tty.term, TTYC_E3));
 
 	c->flags |= CLIENT_SUSPENDED;
+	server_client_dirty(c);
 	server_write_client(c, MSG_LOCK, &lockdata, sizeof lockdata);
 }
 
@@ -369,7 +384,7 @@ server_destroy_pane(struct window_pane *wp)
 		gc.attr |= GRID_ATTR_BRIGHT;
 		screen_write_puts(&ctx, &gc, "Pane is dead");
 		screen_write_stop(&ctx);
-		wp->flags |= PANE_REDRAW;
+		server_redraw_pane(wp);
 		return;
 	}
 
@@ -432,6 +447,7 @@ server_destroy_session(struct session *s)
 		if (s_new == NULL) {
 			c->session = NULL;
 			c->flags |= CLIENT_EXIT;
+			server_client_dirty(c);
 		} else {
 			c->last_session = NULL;
 			c->session = s_new;
@@ -463,17 +479,11 @@ server_check_unattached (void)
 void
 server_set_identify(struct client *c)
 {
-	struct timeval	tv;
-	int		delay;
+	int	delay;
 
 	delay = options_get_number(&c->session->options, "display-panes-time");
-	tv.tv_sec = delay / 1000;
-	tv.tv_usec = (delay % 1000) * 1000L;
-
-	if (event_initialized (&c->identify_timer))
-		evtimer_del(&c->identify_timer);
-	evtimer_set(&c->identify_timer, server_callback_identify, c);
-	evtimer_add(&c->identify_timer, &tv);
+	timer_set(&c->identify_timer, server_callback_identify, c);
+	timer_add(&c->identify_timer, delay);
 
 	c->flags |= CLIENT_IDENTIFY;
 	c->tty.flags |= (TTY_FREEZE|TTY_NOCURSOR);
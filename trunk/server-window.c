@@ -19,6 +19,7 @@
 #include <sys/types.h>
 
 #include <event.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "tmux.h"
@@ -29,8 +30,37 @@ int	server_window_check_silence(struct session *, struct winlink *);
 int	server_window_check_content(
 	    struct session *, struct winlink *, struct window_pane *);
 void	ring_bell(struct session *);
+void	server_window_check_history(void);
 
-/* Window functions that need to happen every loop. */
+/* Windows with a bell, activity or silence which hasn't been looked at. */
+TAILQ_HEAD(, window) server_window_alerts =
+    TAILQ_HEAD_INITIALIZER(server_window_alerts);
+
+/* Set alert flags on a window and queue it to be checked. */
+void
+server_window_alert(struct window *w, int flags)
+{
+	w->flags |= flags;
+	if (w->flags & WINDOW_ALERTQUEUED)
+		return;
+	w->flags |= WINDOW_ALERTQUEUED;
+	TAILQ_INSERT_TAIL(&server_window_alerts, w, alerts_entry);
+}
+
+/* Take a window off the queue when it is destroyed. */
+void
+server_window_cancel_alerts(struct window *w)
+{
+	if (!(w->flags & WINDOW_ALERTQUEUED))
+		return;
+	w->flags &= ~WINDOW_ALERTQUEUED;
+	TAILQ_REMOVE(&server_window_alerts, w, alerts_entry);
+}
+
+/*
+ * Window functions that need to happen every loop. Only windows which have
+ * been queued are checked, and only in the sessions they are linked into.
+ */
 void
 server_window_loop(void)
 {
@@ -38,28 +68,93 @@ server_window_loop(void)
 	struct winlink		*wl;
 	struct window_pane	*wp;
 	struct session		*s;
-	u_int		 	 i;
+	int			 alerted;
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		w = ARRAY_ITEM(&windows, i);
-		if (w == NULL)
-			continue;
+	while ((w = TAILQ_FIRST(&server_window_alerts)) != NULL) {
+		server_window_cancel_alerts(w);
 
-		RB_FOREACH(s, sessions, &sessions) {
-			wl = session_has(s, w);
-			if (wl == NULL)
-				continue;
+		alerted = 0;
+		TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+			s = wl->session;
 
 			if (server_window_check_bell(s, wl) ||
 			    server_window_check_activity(s, wl) ||
-			    server_window_check_silence(s, wl))
+			    server_window_check_silence(s, wl)) {
 				server_status_session(s);
-			TAILQ_FOREACH(wp, &w->panes, entry)
-				server_window_check_content(s, wl, wp);
+				alerted = 1;
+			}
+			TAILQ_FOREACH(wp, &w->panes, entry) {
+				if (server_window_check_content(s, wl, wp))
+					alerted = 1;
+			}
 
 			if (!(s->flags & SESSION_UNATTACHED))
 				w->flags &= ~(WINDOW_BELL|WINDOW_ACTIVITY);
 		}
+
+		/*
+		 * Only one alert is raised for each winlink at a time, so if
+		 * the flags are still set look again for any others.
+		 */
+		if (alerted && w->flags & (WINDOW_BELL|WINDOW_ACTIVITY))
+			server_window_alert(w, 0);
+	}
+
+	server_window_check_history();
+}
+
+/*
+ * Trim history if the grids are using more memory than history-memory-limit,
+ * starting with the window which has gone longest without any output. Windows
+ * which are being displayed and panes in a mode are left alone.
+ */
+void
+server_window_check_history(void)
+{
+	struct window		*w;
+	struct window_pane	*wp, *found;
+	struct grid		*gd;
+	struct timeval		 found_tv;
+	u_int64_t		 limit;
+	u_int			 i;
+
+	limit = options_get_number(&global_options, "history-memory-limit");
+	limit *= 1024;
+	if (limit == 0 || grid_memory <= limit)
+		return;
+
+	while (grid_memory > limit) {
+		found = NULL;
+		for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
+			w = ARRAY_ITEM(&windows, i);
+			if (w == NULL || !TAILQ_EMPTY(&w->clients))
+				continue;
+			if (found != NULL &&
+			    !timercmp(&w->silence_timer, &found_tv, <))
+				continue;
+
+			TAILQ_FOREACH(wp, &w->panes, entry) {
+				gd = wp->base.grid;
+				if (wp->mode == NULL && gd->hsize != 0)
+					break;
+			}
+			if (wp != NULL) {
+				found = wp;
+				memcpy(&found_tv, &w->silence_timer,
+				    sizeof found_tv);
+			}
+		}
+		if (found == NULL)
+			break;
+
+		gd = found->base.grid;
+		while (grid_memory > limit && gd->hsize != 0)
+			grid_drop_history(gd, 100);
+		log_debug("trimmed pane %%%u history to %u lines (%zu bytes)",
+		    found->id, gd->hsize, grid_memory);
+
+		/* UTF-8 entries only used by the history can now go. */
+		grid_utf8_want_collect();
 	}
 }
 
@@ -92,8 +187,7 @@ server_window_check_bell(struct session *s, struct winlink *wl)
 		if (c->session->curw->window == w)
 			status_message_set(c, "Bell in current window");
 		else if (action == BELL_ANY) {
-			status_message_set(c, "Bell in window %u",
-				winlink_find_by_window(&s->windows, w)->idx);
+			status_message_set(c, "Bell in window %u", wl->idx);
 		}
 	}
 
@@ -125,8 +219,7 @@ server_window_check_activity(struct session *s, struct winlink *wl)
 			c = ARRAY_ITEM(&clients, i);
 			if (c == NULL || c->session != s)
 				continue;
-			status_message_set(c, "Activity in window %u",
-			    winlink_find_by_window(&s->windows, w)->idx);
+			status_message_set(c, "Activity in window %u", wl->idx);
 		}
 	}
 
@@ -177,8 +270,7 @@ server_window_check_silence(struct session *s, struct winlink *wl)
 			c = ARRAY_ITEM(&clients, i);
 			if (c == NULL || c->session != s)
 				continue;
-			status_message_set(c, "Silence in window %u",
-			    winlink_find_by_window(&s->windows, w)->idx);
+			status_message_set(c, "Silence in window %u", wl->idx);
 		}
 	}
 
@@ -217,8 +309,7 @@ server_window_check_content(
 			c = ARRAY_ITEM(&clients, i);
 			if (c == NULL || c->session != s)
 				continue;
-			status_message_set(c, "Content in window %u",
-			    winlink_find_by_window(&s->windows, w)->idx);
+			status_message_set(c, "Content in window %u", wl->idx);
 		}
 	}
 
@@ -48,10 +48,14 @@ struct clients	 dead_clients;
 int		 server_fd;
 int		 server_shutdown;
 struct event	 server_ev_accept;
-struct event	 server_ev_second;
+struct timer	 server_ev_second;
 
 struct paste_stack global_buffers;
 
+/* Passes through the loop in this second and in the last. */
+u_int		 server_loop_count;
+u_int		 server_loop_rate;
+
 int		 server_create_socket(void);
 void		 server_loop(void);
 int		 server_should_shutdown(void);
@@ -65,6 +69,7 @@ void		 server_child_stopped(pid_t, int);
 void		 server_second_callback(int, short, void *);
 void		 server_lock_server(void);
 void		 server_lock_sessions(void);
+void		 server_collect_utf8(void);
 
 /* Create server socket. */
 int
@@ -108,7 +113,6 @@ server_start(int lockfd, char *lockfile)
 	struct window_pane	*wp;
 	int	 		 pair[2];
 	char			*cause;
-	struct timeval		 tv;
 	u_int			 i;
 
 	/* The first client is special and gets a socketpair; create it. */
@@ -137,6 +141,7 @@ server_start(int lockfd, char *lockfile)
 	if (event_reinit(ev_base) != 0)
 		fatal("event_reinit failed");
 	clear_signals(0);
+	timer_init();
 
 	logfile("server");
 	log_debug("server started, pid %ld", (long) getpid());
@@ -194,10 +199,8 @@ server_start(int lockfd, char *lockfile)
 
 	server_add_accept(0);
 
-	memset(&tv, 0, sizeof tv);
-	tv.tv_sec = 1;
-	evtimer_set(&server_ev_second, server_second_callback, NULL);
-	evtimer_add(&server_ev_second, &tv);
+	timer_set(&server_ev_second, server_second_callback, NULL);
+	timer_add(&server_ev_second, 1000);
 
 	set_signals(server_signal_callback);
 	server_loop();
@@ -210,6 +213,7 @@ server_loop(void)
 {
 	while (!server_should_shutdown()) {
 		event_loop(EVLOOP_ONCE);
+		server_loop_count++;
 
 		server_window_loop();
 		server_client_loop();
@@ -484,7 +488,6 @@ server_second_callback(unused int fd, unused short events, unused void *arg)
 {
 	struct window		*w;
 	struct window_pane	*wp;
-	struct timeval		 tv;
 	u_int		 	 i;
 
 	if (options_get_number(&global_s_options, "lock-server"))
@@ -501,14 +504,40 @@ server_second_callback(unused int fd, unused short events, unused void *arg)
 			if (wp->mode != NULL && wp->mode->timer != NULL)
 				wp->mode->timer(wp);
 		}
+
+		/* Silence is counted in seconds, so check for it here. */
+		if (w->flags & WINDOW_SILENCE &&
+		    options_get_number(&w->options, "monitor-silence") != 0)
+			server_window_alert(w, WINDOW_SILENCE);
 	}
 
 	server_client_status_timer();
+	server_collect_utf8();
+
+	server_loop_rate = server_loop_count;
+	server_loop_count = 0;
+
+	timer_add(&server_ev_second, 1000);
+}
+
+/* Free UTF-8 table entries which are no longer used by any cell. */
+void
+server_collect_utf8(void)
+{
+	struct client	*c;
+	u_int		 i;
+
+	if (!grid_utf8_mark_start())
+		return;
+
+	grid_mark_utf8();
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c != NULL)
+			tty_mark_utf8(&c->tty);
+	}
 
-	evtimer_del(&server_ev_second);
-	memset(&tv, 0, sizeof tv);
-	tv.tv_sec = 1;
-	evtimer_add(&server_ev_second, &tv);
+	grid_utf8_collect();
 }
 
 /* Lock the server if ALL sessions have hit the time limit. */
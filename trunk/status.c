@@ -748,7 +748,6 @@ status_print(
 void printflike2
 status_message_set(struct client *c, const char *fmt, ...)
 {
-	struct timeval		 tv;
 	struct session		*s = c->session;
 	struct message_entry	*msg;
 	va_list			 ap;
@@ -781,16 +780,12 @@ status_message_set(struct client *c, const char *fmt, ...)
 	}
 
 	delay = options_get_number(&c->session->options, "display-time");
-	tv.tv_sec = delay / 1000;
-	tv.tv_usec = (delay % 1000) * 1000L;
-
-	if (event_initialized (&c->message_timer))
-		evtimer_del(&c->message_timer);
-	evtimer_set(&c->message_timer, status_message_callback, c);
-	evtimer_add(&c->message_timer, &tv);
+	timer_set(&c->message_timer, status_message_callback, c);
+	timer_add(&c->message_timer, delay);
 
 	c->tty.flags |= (TTY_NOCURSOR|TTY_FREEZE);
 	c->flags |= CLIENT_STATUS;
+	server_client_dirty(c);
 }
 
 /* Clear status line message. */
@@ -805,6 +800,7 @@ status_message_clear(struct client *c)
 
 	c->tty.flags &= ~(TTY_NOCURSOR|TTY_FREEZE);
 	c->flags |= CLIENT_REDRAW; /* screen was frozen and may have changed */
+	server_client_dirty(c);
 
 	screen_reinit(&c->status);
 }
@@ -899,6 +895,7 @@ status_prompt_set(struct client *c, const char *msg, const char *input,
 
 	c->tty.flags |= (TTY_NOCURSOR|TTY_FREEZE);
 	c->flags |= CLIENT_STATUS;
+	server_client_dirty(c);
 }
 
 /* Remove status line prompt. */
@@ -919,6 +916,7 @@ status_prompt_clear(struct client *c)
 
 	c->tty.flags &= ~(TTY_NOCURSOR|TTY_FREEZE);
 	c->flags |= CLIENT_REDRAW; /* screen was frozen and may have changed */
+	server_client_dirty(c);
 
 	screen_reinit(&c->status);
 }
@@ -941,6 +939,7 @@ status_prompt_update(struct client *c, const char *msg, const char *input)
 	c->prompt_hindex = 0;
 
 	c->flags |= CLIENT_STATUS;
+	server_client_dirty(c);
 }
 
 /* Draw client prompt on status line of present else on last line. */
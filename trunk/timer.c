@@ -0,0 +1,260 @@
+/* $Id$ */
+
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Server timers.
+ *
+ * Timers are kept on a hashed wheel of TIMER_SLOTS lists, one for each
+ * millisecond, and go on the list for their expiry time modulo the number of
+ * slots. Adding or removing a timer is just a list insert or remove. A single
+ * libevent timer is set for the earliest expiry and when it fires every timer
+ * that is due is run. Timers added with no delay go on a list of their own and
+ * are run on the next pass through the event loop.
+ *
+ * Time is counted in milliseconds from when the wheel is started. This is
+ * taken from gettimeofday but never goes backwards: if the clock is set back,
+ * the start time is moved by the same amount.
+ */
+
+#define TIMER_SLOTS 1024
+
+void		timer_callback(int, short, void *);
+u_int64_t	timer_update(void);
+void		timer_schedule(void);
+
+struct timers	timer_wheel[TIMER_SLOTS];
+struct timers	timer_zero = TAILQ_HEAD_INITIALIZER(timer_zero);
+struct timers	timer_expired = TAILQ_HEAD_INITIALIZER(timer_expired);
+u_int		timer_count;
+
+struct timeval	timer_start;
+struct timeval	timer_last;
+u_int64_t	timer_now;	/* last time from timer_update */
+u_int64_t	timer_done;	/* time up to which timers have been run */
+u_int64_t	timer_next;	/* time the event is set for, 0 if none */
+
+struct event	timer_event;
+
+/* Set up the wheel. */
+void
+timer_init(void)
+{
+	u_int	i;
+
+	for (i = 0; i < TIMER_SLOTS; i++)
+		TAILQ_INIT(&timer_wheel[i]);
+	timer_count = 0;
+
+	if (gettimeofday(&timer_start, NULL) != 0)
+		fatal("gettimeofday failed");
+	memcpy(&timer_last, &timer_start, sizeof timer_last);
+	timer_now = timer_done = timer_next = 0;
+
+	evtimer_set(&timer_event, timer_callback, NULL);
+}
+
+/* Get the current time in milliseconds. */
+u_int64_t
+timer_update(void)
+{
+	struct timeval	tv, back;
+
+	if (gettimeofday(&tv, NULL) != 0)
+		fatal("gettimeofday failed");
+	if (timercmp(&tv, &timer_last, <)) {
+		timersub(&timer_last, &tv, &back);
+		timersub(&timer_start, &back, &timer_start);
+	}
+	memcpy(&timer_last, &tv, sizeof timer_last);
+
+	timersub(&tv, &timer_start, &tv);
+	timer_now = (u_int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	return (timer_now);
+}
+
+/* Set a timer's callback. */
+void
+timer_set(struct timer *t, void (*cb)(int, short, void *), void *data)
+{
+	t->cb = cb;
+	t->data = data;
+}
+
+/* Start a timer, or restart it if already running. */
+void
+timer_add(struct timer *t, u_int msec)
+{
+	struct timeval	tv;
+
+	timer_del(t);
+
+	if (msec == 0) {
+		t->list = &timer_zero;
+		TAILQ_INSERT_TAIL(t->list, t, entry);
+		timer_count++;
+
+		if (TAILQ_FIRST(&timer_zero) == t) {
+			tv.tv_sec = tv.tv_usec = 0;
+			evtimer_del(&timer_event);
+			evtimer_add(&timer_event, &tv);
+		}
+		return;
+	}
+
+	t->expire = timer_update() + msec;
+	t->list = &timer_wheel[t->expire % TIMER_SLOTS];
+	TAILQ_INSERT_TAIL(t->list, t, entry);
+	timer_count++;
+
+	/* Nothing to do if the event is already set for sooner. */
+	if (!TAILQ_EMPTY(&timer_zero))
+		return;
+	if (timer_next != 0 && timer_next <= t->expire)
+		return;
+	timer_next = t->expire;
+
+	tv.tv_sec = msec / 1000;
+	tv.tv_usec = (msec % 1000) * 1000L;
+	evtimer_del(&timer_event);
+	evtimer_add(&timer_event, &tv);
+}
+
+/* Stop a timer. */
+void
+timer_del(struct timer *t)
+{
+	if (t->list == NULL)
+		return;
+	TAILQ_REMOVE(t->list, t, entry);
+	if (t->list != &timer_expired)
+		timer_count--;
+	t->list = NULL;
+}
+
+/* Is this timer running? */
+int
+timer_pending(struct timer *t)
+{
+	return (t->list != NULL && t->list != &timer_expired);
+}
+
+/* Find the earliest timer and set the event for it. */
+void
+timer_schedule(void)
+{
+	struct timer	*t;
+	struct timeval	 tv;
+	u_int64_t	 next, when, delay;
+	u_int		 i;
+
+	evtimer_del(&timer_event);
+	timer_next = 0;
+	if (timer_count == 0)
+		return;
+
+	if (!TAILQ_EMPTY(&timer_zero)) {
+		tv.tv_sec = tv.tv_usec = 0;
+		evtimer_add(&timer_event, &tv);
+		return;
+	}
+
+	/*
+	 * Walk forward one lap of the wheel. The first timer due in the slot
+	 * it is found in is the earliest. If there is none, every timer is
+	 * further away than a lap so use the smallest seen.
+	 */
+	next = 0;
+	for (i = 1; i <= TIMER_SLOTS; i++) {
+		when = timer_done + i;
+		TAILQ_FOREACH(t, &timer_wheel[when % TIMER_SLOTS], entry) {
+			if (t->expire == when) {
+				next = when;
+				break;
+			}
+			if (next == 0 || t->expire < next)
+				next = t->expire;
+		}
+		if (next == when)
+			break;
+	}
+	timer_next = next;
+
+	if (next > timer_now)
+		delay = next - timer_now;
+	else
+		delay = 1;
+	tv.tv_sec = delay / 1000;
+	tv.tv_usec = (delay % 1000) * 1000L;
+	evtimer_add(&timer_event, &tv);
+}
+
+/* Run every timer that is due. */
+/* ARGSUSED */
+void
+timer_callback(unused int fd, unused short events, unused void *data)
+{
+	struct timer	*t, *t1;
+	struct timers	*slot;
+	u_int64_t	 now, when, last;
+
+	now = timer_update();
+
+	/* Move anything due onto the expired list. */
+	while ((t = TAILQ_FIRST(&timer_zero)) != NULL) {
+		TAILQ_REMOVE(&timer_zero, t, entry);
+		TAILQ_INSERT_TAIL(&timer_expired, t, entry);
+		t->list = &timer_expired;
+		timer_count--;
+	}
+	if (now - timer_done >= TIMER_SLOTS)
+		last = timer_done + TIMER_SLOTS;
+	else
+		last = now;
+	for (when = timer_done + 1; when <= last; when++) {
+		slot = &timer_wheel[when % TIMER_SLOTS];
+		for (t = TAILQ_FIRST(slot); t != NULL; t = t1) {
+			t1 = TAILQ_NEXT(t, entry);
+			if (t->expire > now)
+				continue;
+			TAILQ_REMOVE(slot, t, entry);
+			TAILQ_INSERT_TAIL(&timer_expired, t, entry);
+			t->list = &timer_expired;
+			timer_count--;
+		}
+	}
+	timer_done = now;
+
+	/*
+	 * Run them all together. A callback may stop or restart any timer,
+	 * including ones still on the expired list.
+	 */
+	while ((t = TAILQ_FIRST(&timer_expired)) != NULL) {
+		TAILQ_REMOVE(&timer_expired, t, entry);
+		t->list = NULL;
+		t->cb(-1, EV_TIMEOUT, t->data);
+	}
+
+	timer_schedule();
+}
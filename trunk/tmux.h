@@ -55,6 +55,15 @@ extern char   **environ;
 /* Automatic name refresh interval, in milliseconds. */
 #define NAME_INTERVAL 500
 
+/*
+ * Windows checked for automatic-rename at once before the check is split up,
+ * most pieces it is split into, and checks before a command is fetched again
+ * even if the process group has not changed.
+ */
+#define NAME_BATCH 50
+#define NAME_SLICES 5
+#define NAME_REFRESH 10
+
 /*
  * Maximum sizes of strings in message data. Don't forget to bump
  * PROTOCOL_VERSION if any of these change!
@@ -208,6 +217,8 @@ enum tty_code_code {
 	TTYC_CC,	/* set colour cursor, Cc */
 	TTYC_CIVIS,	/* cursor_invisible, vi */
 	TTYC_CLEAR,	/* clear_screen, cl */
+	TTYC_CLMG,	/* clear margins, Clmg */
+	TTYC_CMG,	/* set margins, Cmg */
 	TTYC_CNORM,	/* cursor_normal, ve */
 	TTYC_COLORS,	/* max_colors, Co */
 	TTYC_CR,	/* restore cursor colour, Cr */
@@ -228,13 +239,16 @@ enum tty_code_code {
 	TTYC_DIM,	/* enter_dim_mode, mh */
 	TTYC_DL,	/* parm_delete_line, DL */
 	TTYC_DL1,	/* delete_line, dl */
+	TTYC_DSMG,	/* disable margins, Dsmg */
 	TTYC_E3,
 	TTYC_EL,	/* clr_eol, ce */
 	TTYC_EL1,	/* clr_bol, cb */
 	TTYC_ENACS,	/* ena_acs, eA */
+	TTYC_ENMG,	/* enable margins, Enmg */
 	TTYC_FSL,	/* from_status_line, fsl */
 	TTYC_HOME,	/* cursor_home, ho */
 	TTYC_HPA,	/* column_address, ch */
+	TTYC_HT,	/* tab, ta */
 	TTYC_ICH,	/* parm_ich, IC */
 	TTYC_ICH1,	/* insert_character, ic */
 	TTYC_IL,	/* parm_insert_line, IL */
@@ -243,6 +257,7 @@ enum tty_code_code {
 	TTYC_IS1,	/* init_1string, i1 */
 	TTYC_IS2,	/* init_2string, i2 */
 	TTYC_IS3,	/* init_3string, i3 */
+	TTYC_IT,	/* init_tabs, it */
 	TTYC_KCBT,	/* key_btab, kB */
 	TTYC_KCUB1,	/* key_left, kl */
 	TTYC_KCUD1,	/* key_down, kd */
@@ -339,9 +354,11 @@ enum tty_code_code {
 	TTYC_OP,	/* orig_pair, op */
 	TTYC_REV,	/* enter_reverse_mode, mr */
 	TTYC_RI,	/* scroll_reverse, sr */
+	TTYC_RITM,	/* exit_italics_mode, ritm */
 	TTYC_RMACS,	/* exit_alt_charset_mode */
 	TTYC_RMCUP,	/* exit_ca_mode, te */
 	TTYC_RMKX,	/* keypad_local, ke */
+	TTYC_RMUL,	/* exit_underline_mode, ue */
 	TTYC_SETAB,	/* set_a_background, AB */
 	TTYC_SETAF,	/* set_a_foreground, AF */
 	TTYC_SGR0,	/* exit_attribute_mode, me */
@@ -351,6 +368,7 @@ enum tty_code_code {
 	TTYC_SMKX,	/* keypad_xmit, ks */
 	TTYC_SMSO,	/* enter_standout_mode, so */
 	TTYC_SMUL,	/* enter_underline_mode, us */
+	TTYC_SYNC,	/* synchronized update, Sync */
 	TTYC_TSL,	/* to_status_line, tsl */
 	TTYC_VPA,	/* row_address, cv */
 	TTYC_XENL,	/* eat_newline_glitch, xn */
@@ -366,6 +384,19 @@ enum tty_code_type {
 	TTYCODE_FLAG,
 };
 
+/* Parameterised string which can be written without tparm. */
+struct tty_code_fmt {
+	char		*part[3];	/* before, between and after */
+	size_t		 partlen[3];
+
+	u_int		 nparams;
+	int		 swap;		/* second parameter comes first */
+	u_int		 add[2];	/* added to each parameter */
+
+	u_int		 max;		/* largest parameter */
+	size_t		 size;		/* longest result */
+};
+
 /* Termcap code. */
 struct tty_code {
 	enum tty_code_type	type;
@@ -374,6 +405,8 @@ struct tty_code {
 		int		number;
 		int		flag;
 	} value;
+
+	struct tty_code_fmt	*fmt;
 };
 
 /* Entry in terminal code table. */
@@ -661,16 +694,19 @@ struct utf8_data {
 /* Grid line flags. */
 #define GRID_LINE_WRAPPED 0x1
 
-/* Grid cell data. */
+/*
+ * Grid cell data. For UTF-8 cells, data is the index of the UTF-8 data in the
+ * table in grid-utf8.c.
+ */
 struct grid_cell {
 	u_char	attr;
 	u_char	flags;
 	u_char	fg;
 	u_char	bg;
-	u_char	data;
+	u_int	data;
 } __packed;
 
-/* Grid cell UTF-8 data. Used instead of data in grid_cell for UTF-8 cells. */
+/* Grid cell UTF-8 data. */
 struct grid_utf8 {
 	u_char	width;
 	u_char	data[UTF8_SIZE];
@@ -681,8 +717,7 @@ struct grid_line {
 	u_int	cellsize;
 	struct grid_cell *celldata;
 
-	u_int	utf8size;
-	struct grid_utf8 *utf8data;
+	struct grid_compact *compactdata;
 
 	int	flags;
 } __packed;
@@ -699,6 +734,31 @@ struct grid {
 	u_int	hlimit;
 
 	struct grid_line *linedata;
+	u_int	linesize;	/* allocated lines in linedata */
+	u_int	lineoff;	/* index of line 0 in linedata */
+
+	struct grid_compact *cachesrc;	/* compact line held in cache */
+	struct grid_cell *cachecells;
+	u_int	cachesize;
+
+	struct grid_block **blocks;	/* compressed old history */
+	u_int	nblocks;
+	u_int	coldsize;		/* lines in blocks */
+	u_int	coldoff;		/* lines dropped from first block */
+	size_t	coldbytes;
+	size_t	coldrawbytes;
+
+	u_int	spilllines;		/* lines kept before spilling */
+	int	spillfd;		/* history spill file */
+	u_char *spillmap;
+	size_t	spillmapsize;
+	size_t	spillsize;
+	u_int	nspilled;		/* blocks in spill file */
+	size_t	spillbytes;
+
+	size_t	memory;			/* bytes used */
+
+	TAILQ_ENTRY(grid) entry;
 };
 
 /* Option data structures. */
@@ -779,6 +839,11 @@ struct screen {
 struct screen_write_ctx {
 	struct window_pane *wp;
 	struct screen	*s;
+
+	/* Cells written to the grid but not yet drawn. */
+	u_int		 spanx;
+	u_int		 spany;
+	u_int		 spanlen;
 };
 
 /* Screen size. */
@@ -872,7 +937,6 @@ struct window_pane {
 
 	int		 flags;
 #define PANE_REDRAW 0x1
-#define PANE_DROP 0x2
 
 	char		*cmd;
 	char		*shell;
@@ -881,9 +945,9 @@ struct window_pane {
 	pid_t		 pid;
 	char		 tty[TTY_NAME_MAX];
 
-	u_int		 changes;
-	struct event	 changes_timer;
-	u_int		 changes_redraw;
+	pid_t		 name_pgrp;	/* for automatic-rename */
+	char		*name_cmd;
+	u_int		 name_age;
 
 	int		 fd;
 	struct bufferevent *event;
@@ -923,7 +987,6 @@ struct last_layout {
 struct window {
 	u_int		 id;
 	char		*name;
-	struct event	 name_timer;
 	struct timeval   silence_timer;
 
 	struct window_pane *active;
@@ -944,9 +1007,23 @@ struct window {
 #define WINDOW_ACTIVITY 0x2
 #define WINDOW_REDRAW 0x4
 #define WINDOW_SILENCE 0x8
+#define WINDOW_ALERTQUEUED 0x10
+#define WINDOW_REDRAWQUEUED 0x20
+#define WINDOW_RESIZEQUEUED 0x40
+#define WINDOW_NAMEQUEUED 0x80
 
 	struct options	 options;
 
+	/* Clients whose terminal is showing this window. */
+	TAILQ_HEAD(, client) clients;
+
+	/* Winlinks (and so sessions) containing this window. */
+	TAILQ_HEAD(, winlink) winlinks;
+	TAILQ_ENTRY(window) alerts_entry;
+	TAILQ_ENTRY(window) redraw_entry;
+	TAILQ_ENTRY(window) resize_entry;
+	TAILQ_ENTRY(window) names_entry;
+
 	u_int		 references;
 };
 ARRAY_DECL(windows, struct window *);
@@ -954,6 +1031,7 @@ ARRAY_DECL(windows, struct window *);
 /* Entry on local window list. */
 struct winlink {
 	int		 idx;
+	struct session	*session;
 	struct window	*window;
 
 	size_t		 status_width;
@@ -970,6 +1048,7 @@ struct winlink {
 
 	RB_ENTRY(winlink) entry;
 	TAILQ_ENTRY(winlink) sentry;
+	TAILQ_ENTRY(winlink) wentry;
 };
 RB_HEAD(winlinks, winlink);
 TAILQ_HEAD(winlink_stack, winlink);
@@ -1042,6 +1121,11 @@ struct session {
 	struct winlink_stack lastw;
 	struct winlinks	 windows;
 
+	/* Used by recalculate_sizes. */
+	u_int		 csx;
+	u_int		 csy;
+	struct window	*sizew;
+
 	struct options	 options;
 
 #define SESSION_UNATTACHED 0x1	/* not attached to any clients */
@@ -1082,6 +1166,17 @@ struct mouse_event {
 	u_int	y;
 };
 
+/* Server timer. */
+struct timer {
+	void		(*cb)(int, short, void *);
+	void		*data;
+
+	u_int64_t	 expire;
+	struct timers	*list;
+	TAILQ_ENTRY(timer) entry;
+};
+TAILQ_HEAD(timers, timer);
+
 /* TTY information. */
 struct tty_key {
 	char		 ch;
@@ -1101,15 +1196,42 @@ struct tty_term {
 
 	struct tty_code	 codes[NTTYCODE];
 
+	/* Length of cursor movement codes, with one digit parameters. */
+	u_int		 move_cost[NTTYCODE];
+
+	/* SGR parameters to set and clear each attribute, zero if none. */
+	u_char		 sgr_on[8];
+	u_char		 sgr_off[8];
+
+	/* Synchronized update start and end, empty if not supported. */
+	char		 sync_start[16];
+	char		 sync_end[16];
+
 #define TERM_256COLOURS 0x1
 #define TERM_88COLOURS 0x2
 #define TERM_EARLYWRAP 0x4
+#define TERM_SGR 0x8
 	int		 flags;
 
 	LIST_ENTRY(tty_term) entry;
 };
 LIST_HEAD(tty_terms, tty_term);
 
+/* Size of the buffer output is staged in before going to the bufferevent. */
+#define TTY_BUFSIZE 8192
+
+/* Cached SGR sequence to change from one set of attributes to another. */
+#define TTY_SGR_ENTRIES 32
+struct tty_sgr {
+	u_int64_t	 key;
+
+	char		 s[48];
+	size_t		 len;
+
+	TAILQ_ENTRY(tty_sgr) entry;
+};
+TAILQ_HEAD(tty_sgrs, tty_sgr);
+
 struct tty {
 	struct client	*client;
 
@@ -1129,6 +1251,9 @@ struct tty {
 	u_int		 rlower;
 	u_int		 rupper;
 
+	u_int		 rleft;
+	u_int		 rright;
+
 	char		*termname;
 	struct tty_term	*term;
 
@@ -1141,19 +1266,32 @@ struct tty {
 
 	struct grid_cell cell;
 
+	/* Cells the terminal is known to be showing, sx by sy. */
+	struct grid_cell *shadow;
+
+	/* Output waiting to be passed to the bufferevent. */
+	u_char		 obuf[TTY_BUFSIZE];
+	size_t		 olen;
+
+	/* Recently used SGR sequences, most recent first. */
+	struct tty_sgr	 sgr[TTY_SGR_ENTRIES];
+	struct tty_sgrs	 sgr_list;
+
 #define TTY_NOCURSOR 0x1
 #define TTY_FREEZE 0x2
 #define TTY_ESCAPE 0x4
 #define TTY_UTF8 0x8
 #define TTY_STARTED 0x10
 #define TTY_OPENED 0x20
+#define TTY_BLOCK 0x40
+#define TTY_SYNC 0x80
 	int		 flags;
 
 	int		 term_flags;
 
 	struct mouse_event mouse;
 
-	struct event	 key_timer;
+	struct timer	 key_timer;
 	struct tty_key	*key_tree;
 };
 
@@ -1164,6 +1302,9 @@ struct tty_ctx {
 	const struct grid_cell *cell;
 	const struct grid_utf8 *utf8;
 
+	/* Run of cells on one line, for tty_cmd_cells. */
+	const struct grid_cell *cells;
+
 	u_int		 num;
 	void		*ptr;
 
@@ -1225,7 +1366,11 @@ struct client {
 	struct evbuffer	*stdout_data;
 	struct evbuffer	*stderr_data;
 
-	struct event	 repeat_timer;
+	struct timer	 repeat_timer;
+
+	/* Start of the last frame and timer for the next. */
+	struct timeval	 frame_last;
+	struct timer	 frame_timer;
 
 	struct status_out_tree status_old;
 	struct status_out_tree status_new;
@@ -1246,12 +1391,15 @@ struct client {
 #define CLIENT_READONLY 0x800
 #define CLIENT_REDRAWWINDOW 0x1000
 #define CLIENT_CONTROL 0x2000
+#define CLIENT_FRAMEOPEN 0x4000
+#define CLIENT_FRAMEWAIT 0x8000
+#define CLIENT_DIRTY 0x10000
 	int		 flags;
 
-	struct event	 identify_timer;
+	struct timer	 identify_timer;
 
 	char		*message_string;
-	struct event	 message_timer;
+	struct timer	 message_timer;
 	ARRAY_DECL(, struct message_entry) message_log;
 
 	char		*prompt_string;
@@ -1270,6 +1418,10 @@ struct client {
 	struct session	*session;
 	struct session	*last_session;
 
+	struct window	*window;
+	TAILQ_ENTRY(client) window_entry;
+	TAILQ_ENTRY(client) dirty_entry;
+
 	struct mouse_event last_mouse;
 
 	int		 wlmouse;
@@ -1530,6 +1682,8 @@ void	environ_update(const char *, struct environ *, struct environ *);
 void	environ_push(struct environ *);
 
 /* tty.c */
+extern u_long tty_writes;
+extern u_long tty_write_clients;
 void	tty_init_termios(int, struct termios *, struct bufferevent *);
 void	tty_raw(struct tty *, const char *);
 void	tty_attributes(struct tty *, const struct grid_cell *);
@@ -1544,6 +1698,7 @@ void	tty_putcode2(struct tty *, enum tty_code_code, int, int);
 void	tty_putcode_ptr1(struct tty *, enum tty_code_code, const void *);
 void	tty_putcode_ptr2(struct tty *, enum tty_code_code, const void *, const void *);
 void	tty_puts(struct tty *, const char *);
+void	tty_flush(struct tty *);
 void	tty_putc(struct tty *, u_char);
 void	tty_pututf8(struct tty *, const struct grid_utf8 *);
 void	tty_init(struct tty *, struct client *, int, char *);
@@ -1556,6 +1711,8 @@ void	tty_set_title(struct tty *, const char *);
 void	tty_update_mode(struct tty *, int, struct screen *);
 void	tty_force_cursor_colour(struct tty *, const char *);
 void	tty_draw_line(struct tty *, struct screen *, u_int, u_int, u_int);
+void	tty_invalidate(struct tty *);
+void	tty_mark_utf8(struct tty *);
 int	tty_open(struct tty *, const char *, char **);
 void	tty_close(struct tty *);
 void	tty_free(struct tty *);
@@ -1563,6 +1720,7 @@ void	tty_write(
 	    void (*)(struct tty *, const struct tty_ctx *), struct tty_ctx *);
 void	tty_cmd_alignmenttest(struct tty *, const struct tty_ctx *);
 void	tty_cmd_cell(struct tty *, const struct tty_ctx *);
+void	tty_cmd_cells(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearendofline(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearendofscreen(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearline(struct tty *, const struct tty_ctx *);
@@ -1597,6 +1755,9 @@ const char	*tty_term_ptr2(
 		     struct tty_term *, enum tty_code_code, const void *, const void *);
 int		 tty_term_number(struct tty_term *, enum tty_code_code);
 int		 tty_term_flag(struct tty_term *, enum tty_code_code);
+size_t		 tty_term_format_size(struct tty_term *, enum tty_code_code);
+size_t		 tty_term_format(struct tty_term *,
+		     enum tty_code_code, u_int, u_int, char *, size_t);
 
 /* tty-acs.c */
 const char	*tty_acs_get(struct tty *, u_char);
@@ -1772,6 +1933,7 @@ const char *key_string_lookup_key(int);
 extern struct clients clients;
 extern struct clients dead_clients;
 extern struct paste_stack global_buffers;
+extern u_int server_loop_rate;
 int	 server_start(int, char *);
 void	 server_update_socket(void);
 void	 server_add_accept(int);
@@ -1781,12 +1943,21 @@ void	 server_client_handle_key(struct client *, int);
 void	 server_client_create(int);
 int      server_client_open(struct client *, struct session *, char **);
 void	 server_client_lost(struct client *);
+void	 server_client_set_window(struct client *, struct window *);
+int	 server_client_hold(struct client *);
 void	 server_client_callback(int, short, void *);
 void	 server_client_status_timer(void);
 void	 server_client_loop(void);
+void	 server_client_dirty(struct client *);
+void	 server_client_dirty_all(void);
+void	 server_client_dirty_window(struct window *);
+void	 server_client_queue_redraw(struct window *);
+void	 server_client_cancel_redraw(struct window *);
 
 /* server-window.c */
 void	 server_window_loop(void);
+void	 server_window_alert(struct window *, int);
+void	 server_window_cancel_alerts(struct window *);
 
 /* server-fn.c */
 void	 server_fill_environ(struct session *, struct environ *);
@@ -1803,6 +1974,7 @@ void	 server_status_session(struct session *);
 void	 server_status_session_group(struct session *);
 void	 server_redraw_window(struct window *);
 void	 server_redraw_window_borders(struct window *);
+void	 server_redraw_pane(struct window_pane *);
 void	 server_status_window(struct window *);
 void	 server_lock(void);
 void	 server_lock_session(struct session *);
@@ -1846,11 +2018,14 @@ void	 status_prompt_update(struct client *, const char *, const char *);
 
 /* resize.c */
 void	 recalculate_sizes(void);
+void	 resize_queue_window(struct window *);
+void	 resize_cancel_window(struct window *);
 
 /* input.c */
 void	 input_init(struct window_pane *);
 void	 input_free(struct window_pane *);
 void	 input_parse(struct window_pane *);
+void	 input_parse_buffer(struct window_pane *, const u_char *, size_t);
 
 /* input-key.c */
 void	 input_key(struct window_pane *, int);
@@ -1872,22 +2047,36 @@ u_char	 colour_256to88(u_char);
 const char *attributes_tostring(u_char);
 int	 attributes_fromstring(const char *);
 
+/* compress.c */
+size_t	 compress_data(const u_char *, size_t, u_char *, size_t);
+size_t	 decompress_data(const u_char *, size_t, u_char *, size_t);
+
 /* grid.c */
 extern const struct grid_cell grid_default_cell;
 extern const struct grid_cell grid_marker_cell;
+extern size_t grid_memory;
 struct grid *grid_create(u_int, u_int, u_int);
 void	 grid_destroy(struct grid *);
 int	 grid_compare(struct grid *, struct grid *);
+struct grid_line *grid_get_line(struct grid *, u_int);
+size_t	 grid_line_memory(const struct grid_line *);
+void	 grid_compact_line(struct grid *, u_int);
+int	 grid_inflate_line(struct grid *, u_int);
+void	 grid_adjust_lines(struct grid *, u_int, u_int);
 void	 grid_collect_history(struct grid *);
+void	 grid_drop_history(struct grid *, u_int);
+void	 grid_clear_history(struct grid *);
+int	 grid_thaw_lines(struct grid *, u_int);
+void	 grid_mark_utf8(void);
 void	 grid_scroll_history(struct grid *);
 void	 grid_scroll_history_region(struct grid *, u_int, u_int);
-void	 grid_expand_line(struct grid *, u_int, u_int);
-void	 grid_expand_line_utf8(struct grid *, u_int, u_int);
+int	 grid_expand_line(struct grid *, u_int, u_int);
 const struct grid_cell *grid_peek_cell(struct grid *, u_int, u_int);
 struct grid_cell *grid_get_cell(struct grid *, u_int, u_int);
 void	 grid_set_cell(struct grid *, u_int, u_int, const struct grid_cell *);
+void	 grid_set_cells(struct grid *, u_int, u_int, const struct grid_cell *,
+	     const u_char *, u_int);
 const struct grid_utf8 *grid_peek_utf8(struct grid *, u_int, u_int);
-struct grid_utf8 *grid_get_utf8(struct grid *, u_int, u_int);
 void	 grid_set_utf8(struct grid *, u_int, u_int, const struct grid_utf8 *);
 void	 grid_clear(struct grid *, u_int, u_int, u_int, u_int);
 void	 grid_clear_lines(struct grid *, u_int, u_int);
@@ -1896,21 +2085,30 @@ void	 grid_move_cells(struct grid *, u_int, u_int, u_int, u_int);
 char	*grid_string_cells(struct grid *, u_int, u_int, u_int);
 void	 grid_duplicate_lines(
 	     struct grid *, u_int, struct grid *, u_int, u_int);
+void	 grid_transfer_lines(
+	     struct grid *, u_int, struct grid *, u_int, u_int);
 
 /* grid-utf8.c */
 size_t	 grid_utf8_size(const struct grid_utf8 *);
 size_t	 grid_utf8_copy(const struct grid_utf8 *, char *, size_t);
 void	 grid_utf8_set(struct grid_utf8 *, const struct utf8_data *);
 int	 grid_utf8_append(struct grid_utf8 *, const struct utf8_data *);
-int	 grid_utf8_compare(const struct grid_utf8 *, const struct grid_utf8 *);
+u_int	 grid_utf8_add(const struct grid_utf8 *);
+const struct grid_utf8 *grid_utf8_get(u_int);
+u_int	 grid_utf8_entries(void);
+void	 grid_utf8_want_collect(void);
+int	 grid_utf8_mark_start(void);
+void	 grid_utf8_mark(u_int);
+void	 grid_utf8_collect(void);
 
 /* grid-view.c */
 const struct grid_cell *grid_view_peek_cell(struct grid *, u_int, u_int);
 struct grid_cell *grid_view_get_cell(struct grid *, u_int, u_int);
 void	 grid_view_set_cell(
 	     struct grid *, u_int, u_int, const struct grid_cell *);
+void	 grid_view_set_cells(struct grid *, u_int, u_int,
+	     const struct grid_cell *, const u_char *, u_int);
 const struct grid_utf8 *grid_view_peek_utf8(struct grid *, u_int, u_int);
-struct grid_utf8 *grid_view_get_utf8(struct grid *, u_int, u_int);
 void	 grid_view_set_utf8(
 	     struct grid *, u_int, u_int, const struct grid_utf8 *);
 void	 grid_view_clear_history(struct grid *);
@@ -1978,6 +2176,8 @@ void	 screen_write_clearscreen(struct screen_write_ctx *);
 void	 screen_write_clearhistory(struct screen_write_ctx *);
 void	 screen_write_cell(struct screen_write_ctx *,
 	     const struct grid_cell *, const struct utf8_data *);
+void	 screen_write_cells(struct screen_write_ctx *,
+	     const struct grid_cell *, const u_char *, u_int);
 void	 screen_write_setselection(struct screen_write_ctx *, u_char *, u_int);
 void	 screen_write_rawstring(struct screen_write_ctx *, u_char *, u_int);
 void	 screen_write_bracketpaste(struct screen_write_ctx *, int);
@@ -2048,7 +2248,6 @@ void		 window_destroy_panes(struct window *);
 struct window_pane *window_pane_find_by_id(u_int);
 struct window_pane *window_pane_create(struct window *, u_int, u_int, u_int);
 void		 window_pane_destroy(struct window_pane *);
-void		 window_pane_timer_start(struct window_pane *);
 int		 window_pane_spawn(struct window_pane *, const char *,
 		     const char *, const char *, struct environ *,
 		     struct termios *, char **);
@@ -2146,8 +2345,16 @@ struct window_choose_data	*window_choose_add_session(struct window_pane *,
 
 /* names.c */
 void		 queue_window_name(struct window *);
+void		 cancel_window_name(struct window *);
 char		*default_window_name(struct window *);
 
+/* timer.c */
+void	 timer_init(void);
+void	 timer_set(struct timer *, void (*)(int, short, void *), void *);
+void	 timer_add(struct timer *, u_int);
+void	 timer_del(struct timer *);
+int	 timer_pending(struct timer *);
+
 /* signal.c */
 void set_signals(void(*)(int, short, void *));
 void clear_signals(int);
@@ -0,0 +1,194 @@
+/* $Id$ */
+
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Measure input parser throughput. Each file is read into memory and fed to
+ * input_parse_buffer for a pane with no process, session or client, so only the
+ * parser, screen and grid are timed. Built with "make input-bench":
+ *
+ *	input-bench [-u] [-n count] [-x width] [-y height] file ...
+ *
+ * Each file is parsed count times (default 10) in reads of INPUT_BENCH_READ
+ * bytes and the best time is reported with the rate in megabytes per second.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <limits.h>
+#include <stdio.h>
+
+/* Use the globals and helpers from tmux.c, but not its main. */
+#define main tmux_main
+int	main(int, char **);
+#include "tmux.c"
+#undef main
+
+#define INPUT_BENCH_READ 4096
+
+__dead void	 input_bench_usage(void);
+u_char		*input_bench_read(const char *, size_t *);
+double		 input_bench_run(struct window_pane *, u_char *, size_t);
+
+__dead void
+input_bench_usage(void)
+{
+	fprintf(stderr,
+	    "usage: input-bench [-u] [-n count] [-x width] [-y height] "
+	    "file ...\n");
+	exit(1);
+}
+
+/* Read a whole file into memory. */
+u_char *
+input_bench_read(const char *path, size_t *size)
+{
+	FILE	*f;
+	u_char	*buf;
+	size_t	 len, n;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		return (NULL);
+
+	buf = NULL;
+	len = 0;
+	do {
+		buf = xrealloc(buf, 1, len + BUFSIZ);
+		n = fread(buf + len, 1, BUFSIZ, f);
+		len += n;
+	} while (n == BUFSIZ);
+	if (ferror(f)) {
+		fclose(f);
+		xfree(buf);
+		return (NULL);
+	}
+	fclose(f);
+
+	*size = len;
+	return (buf);
+}
+
+/* Parse a buffer through a pane and return the time taken in seconds. */
+double
+input_bench_run(struct window_pane *wp, u_char *buf, size_t size)
+{
+	struct timeval	start, end;
+	size_t		off, n;
+
+	if (gettimeofday(&start, NULL) != 0)
+		fatal("gettimeofday failed");
+	for (off = 0; off < size; off += n) {
+		n = size - off;
+		if (n > INPUT_BENCH_READ)
+			n = INPUT_BENCH_READ;
+		input_parse_buffer(wp, buf + off, n);
+	}
+	if (gettimeofday(&end, NULL) != 0)
+		fatal("gettimeofday failed");
+
+	timersub(&end, &start, &end);
+	return (end.tv_sec + end.tv_usec / 1000000.0);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct window		*w;
+	struct window_pane	*wp;
+	const char		*errstr;
+	u_char			*buf;
+	size_t			 size;
+	u_int			 count, sx, sy, i;
+	double			 t, best;
+	int			 opt, utf8;
+
+	count = 10;
+	sx = 80;
+	sy = 24;
+	utf8 = 0;
+	while ((opt = getopt(argc, argv, "n:ux:y:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtonum(optarg, 1, UINT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "count %s", errstr);
+			break;
+		case 'u':
+			utf8 = 1;
+			break;
+		case 'x':
+			sx = strtonum(optarg, PANE_MINIMUM, USHRT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "width %s", errstr);
+			break;
+		case 'y':
+			sy = strtonum(optarg, PANE_MINIMUM, USHRT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "height %s", errstr);
+			break;
+		default:
+			input_bench_usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc == 0)
+		input_bench_usage();
+
+	ev_base = osdep_event_init();
+	timer_init();
+	utf8_build();
+
+	options_init(&global_options, NULL);
+	options_table_populate_tree(server_options_table, &global_options);
+	options_init(&global_s_options, NULL);
+	options_table_populate_tree(session_options_table, &global_s_options);
+	options_init(&global_w_options, NULL);
+	options_table_populate_tree(window_options_table, &global_w_options);
+	options_set_number(&global_w_options, "automatic-rename", 0);
+	options_set_number(&global_w_options, "utf8", utf8);
+
+	for (; argc > 0; argc--, argv++) {
+		if ((buf = input_bench_read(argv[0], &size)) == NULL)
+			err(1, "%s", argv[0]);
+
+		/* A new pane for each file so they start from the same state. */
+		w = window_create1(sx, sy);
+		wp = window_add_pane(w, options_get_number(&global_s_options,
+		    "history-limit"));
+		w->active = wp;
+
+		/* Replies to the application are written here and discarded. */
+		wp->event = bufferevent_new(-1, NULL, NULL, NULL, NULL);
+
+		best = 0;
+		for (i = 0; i < count; i++) {
+			t = input_bench_run(wp, buf, size);
+			if (i == 0 || t < best)
+				best = t;
+		}
+		printf("%s: %zu bytes, %.6f seconds, %.1f MB/s\n", argv[0],
+		    size, best, best > 0 ? size / best / 1048576 : 0);
+
+		bufferevent_free(wp->event);
+		wp->event = NULL;
+		xfree(buf);
+	}
+	return (0);
+}
@@ -434,7 +434,6 @@ int
 tty_keys_next(struct tty *tty)
 {
 	struct tty_key	*tk;
-	struct timeval	 tv;
 	const char	*buf;
 	size_t		 len, size;
 	cc_t		 bspace;
@@ -533,7 +532,7 @@ partial_key:
 	 * timer has expired, give up waiting and send the escape.
 	 */
 	if ((tty->flags & TTY_ESCAPE) &&
-	    !evtimer_pending(&tty->key_timer, NULL)) {
+	    !timer_pending(&tty->key_timer)) {
 		evbuffer_drain(tty->event->input, 1);
 		key = '\033';
 		goto handle_key;
@@ -543,18 +542,13 @@ partial_key:
 
 start_timer:
 	/* If already waiting for timer, do nothing. */
-	if (evtimer_pending(&tty->key_timer, NULL))
+	if (timer_pending(&tty->key_timer))
 		return (0);
 
 	/* Start the timer and wait for expiry or more data. */
 	delay = options_get_number(&global_options, "escape-time");
-	tv.tv_sec = delay / 1000;
-	tv.tv_usec = (delay % 1000) * 1000L;
-
-	if (event_initialized(&tty->key_timer))
-		evtimer_del(&tty->key_timer);
-	evtimer_set(&tty->key_timer, tty_keys_callback, tty);
-	evtimer_add(&tty->key_timer, &tv);
+	timer_set(&tty->key_timer, tty_keys_callback, tty);
+	timer_add(&tty->key_timer, delay);
 
 	tty->flags |= TTY_ESCAPE;
 	return (0);
@@ -576,8 +570,7 @@ found_key:
 	goto handle_key;
 
 handle_key:
-	if (event_initialized(&tty->key_timer))
-		evtimer_del(&tty->key_timer);
+	timer_del(&tty->key_timer);
 
 	if (key != KEYC_NONE)
 		server_client_handle_key(tty->client, key);
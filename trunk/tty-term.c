@@ -24,6 +24,7 @@
 #include <ncurses.h>
 #endif
 #include <fnmatch.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <term.h>
@@ -32,9 +33,46 @@
 
 void	 tty_term_override(struct tty_term *, const char *);
 char	*tty_term_strip(const char *);
+void	 tty_term_move_costs(struct tty_term *);
+int	 tty_term_sgr_param(const char *);
+void	 tty_term_sgr(struct tty_term *);
+void	 tty_term_formats(struct tty_term *);
+struct tty_code_fmt *tty_term_build_format(
+	     struct tty_term *, enum tty_code_code, u_int, u_int);
+char	*tty_term_format_part(const char *, size_t);
+size_t	 tty_term_format_number(char *, u_int);
+size_t	 tty_term_format_apply(
+	     struct tty_code_fmt *, u_int, u_int, char *, size_t);
 
 struct tty_terms tty_terms = LIST_HEAD_INITIALIZER(tty_terms);
 
+/*
+ * Codes with parameters which are used often enough to be worth writing
+ * without tparm, with the number of parameters and the largest value tmux
+ * uses. Colours are only ever set this way for the first eight.
+ */
+const struct tty_term_format_entry {
+	enum tty_code_code	code;
+	u_int			nparams;
+	u_int			max;
+} tty_term_formats_table[] = {
+	{ TTYC_CMG, 2, USHRT_MAX },
+	{ TTYC_CSR, 2, USHRT_MAX },
+	{ TTYC_CUB, 1, USHRT_MAX },
+	{ TTYC_CUD, 1, USHRT_MAX },
+	{ TTYC_CUF, 1, USHRT_MAX },
+	{ TTYC_CUP, 2, USHRT_MAX },
+	{ TTYC_CUU, 1, USHRT_MAX },
+	{ TTYC_DCH, 1, USHRT_MAX },
+	{ TTYC_DL, 1, USHRT_MAX },
+	{ TTYC_HPA, 1, USHRT_MAX },
+	{ TTYC_ICH, 1, USHRT_MAX },
+	{ TTYC_IL, 1, USHRT_MAX },
+	{ TTYC_SETAB, 1, 7 },
+	{ TTYC_SETAF, 1, 7 },
+	{ TTYC_VPA, 1, USHRT_MAX },
+};
+
 const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_ACSC, TTYCODE_STRING, "acsc" },
 	{ TTYC_AX, TTYCODE_FLAG, "AX" },
@@ -44,6 +82,8 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_CC, TTYCODE_STRING, "Cc" },
 	{ TTYC_CIVIS, TTYCODE_STRING, "civis" },
 	{ TTYC_CLEAR, TTYCODE_STRING, "clear" },
+	{ TTYC_CLMG, TTYCODE_STRING, "Clmg" },
+	{ TTYC_CMG, TTYCODE_STRING, "Cmg" },
 	{ TTYC_CNORM, TTYCODE_STRING, "cnorm" },
 	{ TTYC_COLORS, TTYCODE_NUMBER, "colors" },
 	{ TTYC_CR, TTYCODE_STRING, "Cr" },
@@ -64,13 +104,16 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_DIM, TTYCODE_STRING, "dim" },
 	{ TTYC_DL, TTYCODE_STRING, "dl" },
 	{ TTYC_DL1, TTYCODE_STRING, "dl1" },
+	{ TTYC_DSMG, TTYCODE_STRING, "Dsmg" },
 	{ TTYC_E3, TTYCODE_STRING, "E3" },
 	{ TTYC_EL, TTYCODE_STRING, "el" },
 	{ TTYC_EL1, TTYCODE_STRING, "el1" },
 	{ TTYC_ENACS, TTYCODE_STRING, "enacs" },
+	{ TTYC_ENMG, TTYCODE_STRING, "Enmg" },
 	{ TTYC_FSL, TTYCODE_STRING, "fsl" },
 	{ TTYC_HOME, TTYCODE_STRING, "home" },
 	{ TTYC_HPA, TTYCODE_STRING, "hpa" },
+	{ TTYC_HT, TTYCODE_STRING, "ht" },
 	{ TTYC_ICH, TTYCODE_STRING, "ich" },
 	{ TTYC_ICH1, TTYCODE_STRING, "ich1" },
 	{ TTYC_IL, TTYCODE_STRING, "il" },
@@ -79,6 +122,7 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_IS1, TTYCODE_STRING, "is1" },
 	{ TTYC_IS2, TTYCODE_STRING, "is2" },
 	{ TTYC_IS3, TTYCODE_STRING, "is3" },
+	{ TTYC_IT, TTYCODE_NUMBER, "it" },
 	{ TTYC_KCBT, TTYCODE_STRING, "kcbt" },
 	{ TTYC_KCUB1, TTYCODE_STRING, "kcub1" },
 	{ TTYC_KCUD1, TTYCODE_STRING, "kcud1" },
@@ -175,9 +219,11 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_OP, TTYCODE_STRING, "op" },
 	{ TTYC_REV, TTYCODE_STRING, "rev" },
 	{ TTYC_RI, TTYCODE_STRING, "ri" },
+	{ TTYC_RITM, TTYCODE_STRING, "ritm" },
 	{ TTYC_RMACS, TTYCODE_STRING, "rmacs" },
 	{ TTYC_RMCUP, TTYCODE_STRING, "rmcup" },
 	{ TTYC_RMKX, TTYCODE_STRING, "rmkx" },
+	{ TTYC_RMUL, TTYCODE_STRING, "rmul" },
 	{ TTYC_SETAB, TTYCODE_STRING, "setab" },
 	{ TTYC_SETAF, TTYCODE_STRING, "setaf" },
 	{ TTYC_SGR0, TTYCODE_STRING, "sgr0" },
@@ -187,6 +233,7 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_SMKX, TTYCODE_STRING, "smkx" },
 	{ TTYC_SMSO, TTYCODE_STRING, "smso" },
 	{ TTYC_SMUL, TTYCODE_STRING, "smul" },
+	{ TTYC_SYNC, TTYCODE_STRING, "Sync" },
 	{ TTYC_TSL, TTYCODE_STRING, "tsl" },
 	{ TTYC_VPA, TTYCODE_STRING, "vpa" },
 	{ TTYC_XENL, TTYCODE_FLAG, "xenl" },
@@ -449,6 +496,24 @@ tty_term_find(char *name, int fd, const char *overrides, char **cause)
 		code->type = TTYCODE_STRING;
 	}
 
+	tty_term_move_costs(term);
+	tty_term_sgr(term);
+	tty_term_formats(term);
+
+	/*
+	 * Build the synchronized update sequences now, as they are added when
+	 * other output which may be in the same terminfo buffer is written.
+	 */
+	*term->sync_start = *term->sync_end = '\0';
+	if (tty_term_has(term, TTYC_SYNC)) {
+		n = strlcpy(term->sync_start,
+		    tty_term_string1(term, TTYC_SYNC, 1), sizeof term->sync_start);
+		if ((size_t) n >= sizeof term->sync_start ||
+		    strlcpy(term->sync_end, tty_term_string1(term, TTYC_SYNC, 2),
+		    sizeof term->sync_end) >= sizeof term->sync_end)
+			*term->sync_start = *term->sync_end = '\0';
+	}
+
 	return (term);
 
 error:
@@ -456,10 +521,340 @@ error:
 	return (NULL);
 }
 
+/*
+ * Work out how long each cursor movement code is, so tty_cursor can pick the
+ * shortest way to move. Parameters are given as zero, so are one digit long.
+ */
+void
+tty_term_move_costs(struct tty_term *term)
+{
+	static const enum tty_code_code	 moves[] = {
+		TTYC_CUB, TTYC_CUB1, TTYC_CUD, TTYC_CUD1, TTYC_CUF, TTYC_CUF1,
+		TTYC_CUP, TTYC_CUU, TTYC_CUU1, TTYC_HOME, TTYC_HPA, TTYC_HT,
+		TTYC_VPA
+	};
+	enum tty_code_code		 code;
+	u_int				 i;
+
+	for (i = 0; i < NTTYCODE; i++)
+		term->move_cost[i] = UINT_MAX;
+	for (i = 0; i < nitems(moves); i++) {
+		code = moves[i];
+		if (tty_term_has(term, code)) {
+			term->move_cost[code] =
+			    strlen(tty_term_string2(term, code, 0, 0));
+		}
+	}
+}
+
+/* Get the parameter from a string which is only "\033[Nm", or -1. */
+int
+tty_term_sgr_param(const char *s)
+{
+	const char	*errstr;
+	char		 tmp[8];
+	size_t		 len;
+	int		 n;
+
+	if (strncmp(s, "\033[", 2) != 0)
+		return (-1);
+	s += 2;
+	len = strlen(s);
+	if (len < 2 || len >= sizeof tmp || s[len - 1] != 'm')
+		return (-1);
+	memcpy(tmp, s, len - 1);
+	tmp[len - 1] = '\0';
+
+	n = strtonum(tmp, 1, UCHAR_MAX, &errstr);
+	if (errstr != NULL)
+		return (-1);
+	return (n);
+}
+
+/*
+ * Work out if attributes and colours are set with plain SGR sequences. If so,
+ * TERM_SGR is set and tty_attributes can put several changes into one
+ * sequence. The parameter for each attribute is stored in sgr_on and, if the
+ * terminal has a code to clear it on its own, sgr_off.
+ */
+void
+tty_term_sgr(struct tty_term *term)
+{
+	/* In the same order as the GRID_ATTR_* bits. */
+	static const enum tty_code_code	 on[] = {
+		TTYC_BOLD, TTYC_DIM, TTYC_SMUL, TTYC_BLINK, TTYC_REV,
+		TTYC_INVIS, TTYC_SITM
+	};
+	const char			*s;
+	size_t				 len;
+	u_int				 i;
+	int				 n;
+
+	memset(term->sgr_on, 0, sizeof term->sgr_on);
+	memset(term->sgr_off, 0, sizeof term->sgr_off);
+	term->flags &= ~TERM_SGR;
+
+	/* sgr0 may also reset the character set, which is done separately. */
+	if (!tty_term_has(term, TTYC_SGR0))
+		return;
+	s = tty_term_string(term, TTYC_SGR0);
+	if (strncmp(s, "\033(B", 3) == 0)
+		s += 3;
+	len = strlen(s);
+	if (len != 0 && s[len - 1] == '\017')
+		len--;
+	if ((len != 3 || strncmp(s, "\033[m", 3) != 0) &&
+	    (len != 4 || strncmp(s, "\033[0m", 4) != 0))
+		return;
+
+	/* The colours must follow the usual pattern. */
+	if (!tty_term_has(term, TTYC_SETAF) || !tty_term_has(term, TTYC_SETAB))
+		return;
+	if (strcmp(tty_term_string1(term, TTYC_SETAF, 1), "\033[31m") != 0)
+		return;
+	if (strcmp(tty_term_string1(term, TTYC_SETAB, 1), "\033[41m") != 0)
+		return;
+
+	for (i = 0; i < nitems(on); i++) {
+		/* Italics and reverse fall back to standout. */
+		if (tty_term_has(term, on[i]))
+			s = tty_term_string(term, on[i]);
+		else if ((on[i] == TTYC_SITM || on[i] == TTYC_REV) &&
+		    tty_term_has(term, TTYC_SMSO))
+			s = tty_term_string(term, TTYC_SMSO);
+		else
+			continue;
+		if ((n = tty_term_sgr_param(s)) == -1)
+			return;
+		term->sgr_on[i] = n;
+	}
+
+	/* Only underscore and italics can be cleared without resetting. */
+	if (tty_term_has(term, TTYC_SMUL) && tty_term_has(term, TTYC_RMUL)) {
+		n = tty_term_sgr_param(tty_term_string(term, TTYC_RMUL));
+		if (n != -1)
+			term->sgr_off[2] = n;
+	}
+	if (tty_term_has(term, TTYC_SITM) && tty_term_has(term, TTYC_RITM)) {
+		n = tty_term_sgr_param(tty_term_string(term, TTYC_RITM));
+		if (n != -1)
+			term->sgr_off[6] = n;
+	}
+
+	term->flags |= TERM_SGR;
+}
+
+/*
+ * Work out which of the common codes with parameters are simple enough, once
+ * tparm has been run, to be written directly. This means being a fixed string
+ * with one or two numbers in it, which is true for nearly every terminal.
+ */
+void
+tty_term_formats(struct tty_term *term)
+{
+	const struct tty_term_format_entry	*ent;
+	u_int					 i;
+
+	for (i = 0; i < nitems(tty_term_formats_table); i++) {
+		ent = &tty_term_formats_table[i];
+		term->codes[ent->code].fmt = tty_term_build_format(term,
+		    ent->code, ent->nparams, ent->max);
+		if (term->codes[ent->code].fmt == NULL &&
+		    tty_term_has(term, ent->code))
+			log_debug("%s: %s needs tparm", term->name,
+			    tty_term_codes[ent->code].name);
+	}
+}
+
+/*
+ * Look at what tparm gives for a code to find where the parameters go, then
+ * check it gives the same for a spread of other values.
+ */
+struct tty_code_fmt *
+tty_term_build_format(struct tty_term *term, enum tty_code_code code,
+    u_int nparams, u_int max)
+{
+	static const u_int	 tests[] = {
+		0, 1, 2, 7, 8, 9, 10, 42, 99, 100, 101, 999, 1000, 12345
+	};
+	struct tty_code_fmt	 fmt, *copy;
+	const char		*where[2], *ptr;
+	char			 s[128], out[128], n[16];
+	size_t			 len[2], size;
+	u_int			 v[2], i, j, a, b;
+
+	if (!tty_term_has(term, code))
+		return (NULL);
+
+	/* Use values which should not appear otherwise and look for them. */
+	v[0] = max < 100 ? 5 : 123;
+	v[1] = 234;
+	size = strlcpy(s, tty_term_string2(term, code, v[0], v[1]), sizeof s);
+	if (size >= sizeof s)
+		return (NULL);
+
+	memset(&fmt, 0, sizeof fmt);
+	fmt.nparams = nparams;
+	fmt.max = max;
+	for (i = 0; i < nparams; i++) {
+		where[i] = NULL;
+		for (j = 0; j < 2; j++) {
+			xsnprintf(n, sizeof n, "%u", v[i] + j);
+			if ((ptr = strstr(s, n)) == NULL)
+				continue;
+			if (where[i] != NULL || strstr(ptr + 1, n) != NULL)
+				return (NULL);
+			where[i] = ptr;
+			len[i] = strlen(n);
+			fmt.add[i] = j;
+		}
+		if (where[i] == NULL)
+			return (NULL);
+	}
+
+	/* Split into the parts before, between and after the parameters. */
+	if (nparams == 1) {
+		fmt.part[0] = tty_term_format_part(s, where[0] - s);
+		fmt.part[1] = xstrdup("");
+		fmt.part[2] = xstrdup(where[0] + len[0]);
+	} else {
+		if (where[1] < where[0]) {
+			fmt.swap = 1;
+			ptr = where[0];
+			where[0] = where[1];
+			where[1] = ptr;
+			size = len[0];
+			len[0] = len[1];
+			len[1] = size;
+		}
+		if (where[0] + len[0] > where[1])
+			return (NULL);
+		fmt.part[0] = tty_term_format_part(s, where[0] - s);
+		fmt.part[1] = tty_term_format_part(where[0] + len[0],
+		    where[1] - (where[0] + len[0]));
+		fmt.part[2] = xstrdup(where[1] + len[1]);
+	}
+	fmt.size = 1;
+	for (i = 0; i < nitems(fmt.part); i++) {
+		fmt.partlen[i] = strlen(fmt.part[i]);
+		fmt.size += fmt.partlen[i];
+	}
+	fmt.size += nparams * 10;
+
+	/* Make sure it is the same as tparm over the range of values. */
+	for (i = 0; i < nitems(tests) + 8; i++) {
+		a = i < 8 ? i : tests[i - 8];
+		b = nparams == 1 ? 0 : tests[(i + 3) % nitems(tests)];
+		if (a > max || b > max)
+			continue;
+		size = tty_term_format_apply(&fmt, a, b, out, sizeof out);
+		if (size == 0 || size >= sizeof out)
+			break;
+		out[size] = '\0';
+		if (strcmp(out, tty_term_string2(term, code, a, b)) != 0)
+			break;
+	}
+	if (i != nitems(tests) + 8) {
+		for (i = 0; i < nitems(fmt.part); i++)
+			xfree(fmt.part[i]);
+		return (NULL);
+	}
+
+	copy = xmalloc(sizeof *copy);
+	memcpy(copy, &fmt, sizeof *copy);
+	return (copy);
+}
+
+/* Copy part of a format string. */
+char *
+tty_term_format_part(const char *s, size_t len)
+{
+	char	*part;
+
+	part = xmalloc(len + 1);
+	memcpy(part, s, len);
+	part[len] = '\0';
+	return (part);
+}
+
+/* Write a number in decimal, returning its length. */
+size_t
+tty_term_format_number(char *buf, u_int n)
+{
+	char	tmp[16];
+	size_t	len, i;
+
+	len = 0;
+	do {
+		tmp[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n != 0);
+	for (i = 0; i < len; i++)
+		buf[i] = tmp[len - i - 1];
+	return (len);
+}
+
+/* Longest a code written without tparm can be, or 0 if it must use tparm. */
+size_t
+tty_term_format_size(struct tty_term *term, enum tty_code_code code)
+{
+	if (term->codes[code].fmt == NULL)
+		return (0);
+	return (term->codes[code].fmt->size);
+}
+
+/*
+ * Write a code with parameters into a buffer without tparm. Returns the length
+ * (not terminated) or 0 if it can't be done.
+ */
+size_t
+tty_term_format(struct tty_term *term, enum tty_code_code code, u_int a,
+    u_int b, char *buf, size_t len)
+{
+	struct tty_code_fmt	*fmt = term->codes[code].fmt;
+
+	if (fmt == NULL)
+		return (0);
+	return (tty_term_format_apply(fmt, a, b, buf, len));
+}
+
+/* Fill in a format. */
+size_t
+tty_term_format_apply(struct tty_code_fmt *fmt, u_int a, u_int b, char *buf,
+    size_t len)
+{
+	char	*ptr = buf;
+	u_int	 tmp;
+
+	if (a > fmt->max || b > fmt->max || len < fmt->size)
+		return (0);
+	a += fmt->add[0];
+	b += fmt->add[1];
+	if (fmt->swap) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	memcpy(ptr, fmt->part[0], fmt->partlen[0]);
+	ptr += fmt->partlen[0];
+	ptr += tty_term_format_number(ptr, a);
+	if (fmt->nparams == 2) {
+		memcpy(ptr, fmt->part[1], fmt->partlen[1]);
+		ptr += fmt->partlen[1];
+		ptr += tty_term_format_number(ptr, b);
+	}
+	memcpy(ptr, fmt->part[2], fmt->partlen[2]);
+	ptr += fmt->partlen[2];
+
+	return (ptr - buf);
+}
+
 void
 tty_term_free(struct tty_term *term)
 {
-	u_int	i;
+	struct tty_code_fmt	*fmt;
+	u_int			 i, j;
 
 	if (--term->references != 0)
 		return;
@@ -469,6 +864,11 @@ tty_term_free(struct tty_term *term)
 	for (i = 0; i < NTTYCODE; i++) {
 		if (term->codes[i].type == TTYCODE_STRING)
 			xfree(term->codes[i].value.string);
+		if ((fmt = term->codes[i].fmt) != NULL) {
+			for (j = 0; j < nitems(fmt->part); j++)
+				xfree(fmt->part[j]);
+			xfree(fmt);
+		}
 	}
 	xfree(term->name);
 	xfree(term);
@@ -31,13 +31,42 @@
 
 #include "tmux.h"
 
+/* Cursor movement step, for tty_cursor. */
+enum tty_move_type {
+	TTY_MOVE_NONE,
+	TTY_MOVE_LF,		/* n linefeeds */
+	TTY_MOVE_REPEAT,	/* code n times */
+	TTY_MOVE_RELATIVE,	/* code with n as parameter */
+	TTY_MOVE_ABSOLUTE,	/* code with position n */
+	TTY_MOVE_PRINT		/* write the last n cells again */
+};
+struct tty_move {
+	enum tty_move_type	type;
+	enum tty_code_code	code;
+	u_int			n;
+
+	u_int			tabs;	/* tabs before the step */
+	int			cr;	/* carriage return first */
+
+	u_int			cost;
+};
+
+/* Longest run of cells to write again rather than move over. */
+#define TTY_MOVE_PRINT_MAX 8
+
 void	tty_read_callback(struct bufferevent *, void *);
+void	tty_write_callback(struct bufferevent *, void *);
 void	tty_error_callback(struct bufferevent *, short, void *);
 
 int	tty_try_256(struct tty *, u_char, const char *);
 int	tty_try_88(struct tty *, u_char, const char *);
 
 void	tty_colours(struct tty *, const struct grid_cell *);
+void	tty_sgr_clear(struct tty *);
+void printflike4 tty_sgr_add(char *, size_t, size_t *, const char *, ...);
+int	tty_sgr_encode(struct tty *, const struct grid_cell *,
+	    const struct grid_cell *, int, char *, size_t);
+int	tty_sgr(struct tty *, const struct grid_cell *);
 void	tty_check_fg(struct tty *, struct grid_cell *);
 void	tty_check_bg(struct tty *, struct grid_cell *);
 void	tty_colours_fg(struct tty *, const struct grid_cell *);
@@ -49,9 +78,37 @@ void	tty_cra_pane(struct tty *,
 void	tty_era_pane(struct tty *,
     const struct tty_ctx *, u_int, u_int, u_int, u_int);
 void	tty_redraw_region(struct tty *, const struct tty_ctx *);
+void	tty_margin_off(struct tty *);
+void	tty_margin_pane(struct tty *, const struct tty_ctx *);
+void	tty_margin(struct tty *, u_int, u_int);
 void	tty_emulate_repeat(
 	    struct tty *, enum tty_code_code, enum tty_code_code, u_int);
 void	tty_repeat_space(struct tty *, u_int);
+void	tty_cells(struct tty *, const struct grid_cell *, u_int);
+u_int	tty_move_digits(u_int);
+void	tty_move_try(struct tty *, struct tty_move *, enum tty_move_type,
+	    enum tty_code_code, u_int);
+int	tty_move_print(struct tty *, u_int, u_int, u_int);
+void	tty_move_right(struct tty *, u_int, u_int, u_int, struct tty_move *);
+void	tty_move_put(struct tty *, struct tty_move *, u_int, u_int);
+void	tty_add(struct tty *, const void *, size_t);
+u_char *tty_reserve(struct tty *, size_t);
+int	tty_putcode_format(struct tty *, enum tty_code_code, u_int, u_int);
+void	tty_write_buffer(struct tty *);
+int	tty_backlog(struct tty *, size_t);
+void	tty_shadow_resize(struct tty *);
+const struct grid_cell *tty_shadow_blank(struct tty *);
+void	tty_shadow_fill(struct tty *, u_int, u_int, u_int,
+	    const struct grid_cell *);
+void	tty_shadow_set(struct tty *, u_int, u_int, const struct grid_cell *);
+void	tty_shadow_putc(struct tty *, u_int, u_int, u_char);
+void	tty_shadow_scroll(struct tty *);
+void	tty_shadow_code(struct tty *, enum tty_code_code);
+int	tty_shadow_same(struct tty *, u_int, u_int, const struct grid_cell *);
+const struct grid_cell *tty_draw_get(
+	    struct screen *, u_int, u_int, struct grid_cell *);
+int	tty_draw_skip(struct tty *, struct screen *, u_int, u_int, u_int,
+	    u_int, u_int, int);
 void	tty_cell(struct tty *,
 	    const struct grid_cell *, const struct grid_utf8 *);
 
@@ -59,10 +116,31 @@ void	tty_cell(struct tty *,
 	(tty_term_has((tty)->term, TTYC_ACSC) && !((tty)->flags & TTY_UTF8))
 #define tty_use_rect(tty) \
 	((tty)->xterm_version > 270)
+#define tty_use_margin(tty) \
+	(tty_term_has((tty)->term, TTYC_CMG) && \
+	tty_term_has((tty)->term, TTYC_ENMG))
 
 #define tty_pane_full_width(tty, ctx) \
 	((ctx)->xoff == 0 && screen_size_x((ctx)->wp->screen) >= (tty)->sx)
 
+/* Number of tty_write calls and of clients looked at by them. */
+u_long	tty_writes;
+u_long	tty_write_clients;
+
+/*
+ * Cell in the shadow whose content is not known. It never matches a real
+ * cell.
+ */
+const struct grid_cell tty_shadow_unknown = { 0xff, 0xff, 0, 0, UINT_MAX };
+
+#define tty_shadow_cell(tty, x, y) (&(tty)->shadow[(y) * (tty)->sx + (x)])
+
+/*
+ * Shortest run of unchanged cells worth moving the cursor over rather than
+ * writing them again.
+ */
+#define TTY_SHADOW_SKIP 8
+
 void
 tty_init(struct tty *tty, struct client *c, int fd, char *term)
 {
@@ -114,6 +192,9 @@ tty_resize(struct tty *tty)
 	tty->rupper = UINT_MAX;
 	tty->rlower = UINT_MAX;
 
+	tty->rleft = UINT_MAX;
+	tty->rright = UINT_MAX;
+
 	/*
 	 * If the terminal has been started, reset the actual scroll region and
 	 * cursor position, as this may not have happened.
@@ -121,6 +202,7 @@ tty_resize(struct tty *tty)
 	if (tty->flags & TTY_STARTED) {
 		tty_cursor(tty, 0, 0);
 		tty_region(tty, 0, tty->sy - 1);
+		tty_margin_off(tty);
 	}
 
 	return (1);
@@ -132,9 +214,252 @@ tty_set_size(struct tty *tty, u_int sx, u_int sy) {
 		return (0);
 	tty->sx = sx;
 	tty->sy = sy;
+	if (tty->shadow != NULL)
+		tty_shadow_resize(tty);
 	return (1);
 }
 
+/*
+ * The shadow is a copy of the cells the terminal is showing, as far as they
+ * are known. Cells are recorded as they are drawn and anything that changes
+ * the terminal in a less predictable way marks the cells it touches as
+ * unknown. tty_draw_line can then skip cells the terminal already shows.
+ * Terminals that wrap early are not worth the trouble and have no shadow.
+ */
+void
+tty_shadow_resize(struct tty *tty)
+{
+	if (tty->shadow != NULL)
+		xfree(tty->shadow);
+	tty->shadow = NULL;
+
+	if (tty->term->flags & TERM_EARLYWRAP)
+		return;
+	tty->shadow = xcalloc(tty->sx * tty->sy, sizeof *tty->shadow);
+	tty_invalidate(tty);
+}
+
+/* Forget everything the terminal is showing. */
+void
+tty_invalidate(struct tty *tty)
+{
+	u_int	yy;
+
+	for (yy = 0; yy < tty->sy; yy++)
+		tty_shadow_fill(tty, 0, yy, tty->sx, &tty_shadow_unknown);
+}
+
+/*
+ * Mark the UTF-8 indexes in the shadow as in use. Unknown cells have an index
+ * past the end of the table, so they are ignored.
+ */
+void
+tty_mark_utf8(struct tty *tty)
+{
+	struct grid_cell	*gc;
+	u_int			 i;
+
+	if (tty->shadow == NULL)
+		return;
+	for (i = 0; i < tty->sx * tty->sy; i++) {
+		gc = &tty->shadow[i];
+		if (gc->flags & GRID_FLAG_UTF8)
+			grid_utf8_mark(gc->data);
+	}
+}
+
+/*
+ * Cell left by clearing in the current attributes. Only blanks in the default
+ * attributes are certain to look the same when drawn again, so anything else
+ * is unknown.
+ */
+const struct grid_cell *
+tty_shadow_blank(struct tty *tty)
+{
+	if (tty->cell.attr == 0 && tty->cell.flags == 0 &&
+	    tty->cell.fg == 8 && tty->cell.bg == 8)
+		return (&grid_default_cell);
+	return (&tty_shadow_unknown);
+}
+
+/* Fill part of a line of the shadow with a cell. */
+void
+tty_shadow_fill(struct tty *tty, u_int px, u_int py, u_int nx,
+    const struct grid_cell *gc)
+{
+	u_int	xx;
+
+	if (tty->shadow == NULL || py >= tty->sy || px >= tty->sx)
+		return;
+	if (nx > tty->sx - px)
+		nx = tty->sx - px;
+
+	for (xx = px; xx < px + nx; xx++)
+		memcpy(tty_shadow_cell(tty, xx, py), gc, sizeof *gc);
+}
+
+/* Record a cell drawn at a position, with padding if it is wide. */
+void
+tty_shadow_set(
+    struct tty *tty, u_int px, u_int py, const struct grid_cell *gc)
+{
+	const struct grid_utf8	*gu;
+	u_int			 width, xx;
+
+	if (tty->shadow == NULL || py >= tty->sy || px >= tty->sx)
+		return;
+
+	width = 1;
+	if (gc->flags & GRID_FLAG_UTF8) {
+		gu = grid_utf8_get(gc->data);
+		width = gu->width;
+	}
+	if (px + width > tty->sx) {
+		/* The terminal will have wrapped it onto the next line. */
+		tty_invalidate(tty);
+		return;
+	}
+
+	memcpy(tty_shadow_cell(tty, px, py), gc, sizeof *gc);
+	for (xx = px + 1; xx < px + width; xx++) {
+		memcpy(tty_shadow_cell(tty, xx, py), gc, sizeof *gc);
+		tty_shadow_cell(tty, xx, py)->flags |= GRID_FLAG_PADDING;
+	}
+}
+
+/*
+ * Record a character written directly. It is only known if it is in the
+ * default attributes, for the same reason as tty_shadow_blank.
+ */
+void
+tty_shadow_putc(struct tty *tty, u_int px, u_int py, u_char ch)
+{
+	const struct grid_cell	*blank;
+	struct grid_cell	 gc;
+
+	if (tty->shadow == NULL)
+		return;
+	if (px >= tty->sx || py >= tty->sy) {
+		tty_invalidate(tty);
+		return;
+	}
+
+	blank = tty_shadow_blank(tty);
+	if (blank == &tty_shadow_unknown) {
+		tty_shadow_fill(tty, px, py, 1, blank);
+		return;
+	}
+	memcpy(&gc, blank, sizeof gc);
+	gc.data = ch;
+	tty_shadow_set(tty, px, py, &gc);
+}
+
+/* Scroll the shadow scroll region up by one line, inside the margins. */
+void
+tty_shadow_scroll(struct tty *tty)
+{
+	u_int	upper = tty->rupper, lower = tty->rlower, yy;
+	u_int	left = 0, right = tty->sx - 1;
+
+	if (tty->shadow == NULL)
+		return;
+	if (upper >= tty->sy || lower >= tty->sy || upper > lower) {
+		tty_invalidate(tty);
+		return;
+	}
+	if (tty->rleft != UINT_MAX) {
+		left = tty->rleft;
+		right = tty->rright;
+		if (left > right || right >= tty->sx) {
+			tty_invalidate(tty);
+			return;
+		}
+	}
+
+	if (left == 0 && right == tty->sx - 1) {
+		memmove(tty_shadow_cell(tty, 0, upper),
+		    tty_shadow_cell(tty, 0, upper + 1),
+		    (lower - upper) * tty->sx * sizeof *tty->shadow);
+	} else {
+		for (yy = upper; yy < lower; yy++) {
+			memcpy(tty_shadow_cell(tty, left, yy),
+			    tty_shadow_cell(tty, left, yy + 1),
+			    (right - left + 1) * sizeof *tty->shadow);
+		}
+	}
+	tty_shadow_fill(tty, left, lower, right - left + 1,
+	    tty_shadow_blank(tty));
+}
+
+/* Update the shadow for a terminal code which changes the content. */
+void
+tty_shadow_code(struct tty *tty, enum tty_code_code code)
+{
+	u_int	cx, cy = tty->cy, yy;
+
+	if (tty->shadow == NULL)
+		return;
+
+	/* The cursor may be waiting to wrap after the last column. */
+	cx = tty->cx;
+	if (cx > tty->sx - 1)
+		cx = tty->sx - 1;
+
+	switch (code) {
+	case TTYC_EL:
+		if (cy >= tty->sy)
+			tty_invalidate(tty);
+		else {
+			tty_shadow_fill(tty, cx, cy, tty->sx - cx,
+			    tty_shadow_blank(tty));
+		}
+		break;
+	case TTYC_EL1:
+		if (cy >= tty->sy)
+			tty_invalidate(tty);
+		else
+			tty_shadow_fill(tty, 0, cy, cx + 1,
+			    tty_shadow_blank(tty));
+		break;
+	case TTYC_CLEAR:
+		for (yy = 0; yy < tty->sy; yy++)
+			tty_shadow_fill(tty, 0, yy, tty->sx,
+			    tty_shadow_blank(tty));
+		break;
+	case TTYC_ICH:
+	case TTYC_ICH1:
+	case TTYC_DCH:
+	case TTYC_DCH1:
+		if (cy >= tty->sy)
+			tty_invalidate(tty);
+		else
+			tty_shadow_fill(tty, 0, cy, tty->sx,
+			    &tty_shadow_unknown);
+		break;
+	case TTYC_IL:
+	case TTYC_IL1:
+	case TTYC_DL:
+	case TTYC_DL1:
+	case TTYC_RI:
+	case TTYC_SMCUP:
+	case TTYC_RMCUP:
+		tty_invalidate(tty);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Is the terminal known to be showing this cell at this position? */
+int
+tty_shadow_same(
+    struct tty *tty, u_int px, u_int py, const struct grid_cell *gc)
+{
+	if (tty->shadow == NULL || py >= tty->sy || px >= tty->sx)
+		return (0);
+	return (memcmp(tty_shadow_cell(tty, px, py), gc, sizeof *gc) == 0);
+}
+
 int
 tty_open(struct tty *tty, const char *overrides, char **cause)
 {
@@ -155,11 +480,12 @@ tty_open(struct tty *tty, const char *overrides, char **cause)
 		return (-1);
 	}
 	tty->flags |= TTY_OPENED;
+	tty_sgr_clear(tty);
 
-	tty->flags &= ~(TTY_NOCURSOR|TTY_FREEZE|TTY_ESCAPE);
+	tty->flags &= ~(TTY_NOCURSOR|TTY_FREEZE|TTY_ESCAPE|TTY_BLOCK|TTY_SYNC);
 
-	tty->event = bufferevent_new(
-	    tty->fd, tty_read_callback, NULL, tty_error_callback, tty);
+	tty->event = bufferevent_new(tty->fd,
+	    tty_read_callback, tty_write_callback, tty_error_callback, tty);
 
 	tty_start_tty(tty);
 
@@ -178,6 +504,54 @@ tty_read_callback(unused struct bufferevent *bufev, void *data)
 		;
 }
 
+/*
+ * Output has been written. If the terminal was blocked because it had fallen
+ * too far behind, it has now caught up, so put it back into a known state and
+ * redraw it.
+ */
+/* ARGSUSED */
+void
+tty_write_callback(unused struct bufferevent *bufev, void *data)
+{
+	struct tty	*tty = data;
+
+	if (!(tty->flags & TTY_BLOCK))
+		return;
+	tty->flags &= ~TTY_BLOCK;
+	log_debug("%s: unblocked", tty->path);
+	server_client_dirty(tty->client);
+
+	tty_putcode(tty, TTYC_SGR0);
+	memcpy(&tty->cell, &grid_default_cell, sizeof tty->cell);
+
+	tty->cx = UINT_MAX;
+	tty->cy = UINT_MAX;
+
+	tty->rupper = UINT_MAX;
+	tty->rlower = UINT_MAX;
+
+	/* The margins may have been set and the reset dropped. */
+	tty->rleft = UINT_MAX;
+	tty->rright = UINT_MAX;
+	tty_margin_off(tty);
+
+	/*
+	 * Mode changes may also have been dropped, so turn them all off, as
+	 * when the terminal is started, and let the redraw set them again.
+	 */
+	tty_putcode(tty, TTYC_RMKX);
+	tty_putcode(tty, TTYC_CNORM);
+	if (tty_term_has(tty->term, TTYC_KMOUS)) {
+		tty_puts(tty, "\033[?1003l\033[?1002l\033[?1000l");
+		tty_puts(tty, "\033[?1005l");
+	}
+	tty_puts(tty, "\033[?2004l");
+	tty->mode = MODE_CURSOR;
+
+	tty_invalidate(tty);
+	server_redraw_client(tty->client);
+}
+
 /* ARGSUSED */
 void
 tty_error_callback(
@@ -214,6 +588,7 @@ void
 tty_start_tty(struct tty *tty)
 {
 	tty_init_termios(tty->fd, &tty->tio, tty->event);
+	tty_shadow_resize(tty);
 
 	tty_putcode(tty, TTYC_SMCUP);
 
@@ -231,6 +606,8 @@ tty_start_tty(struct tty *tty)
 
 	if (tty_term_has(tty->term, TTYC_XT))
 		tty_puts(tty, "\033[>c");
+	if (tty_use_margin(tty))
+		tty_putcode(tty, TTYC_ENMG);
 
 	tty->cx = UINT_MAX;
 	tty->cy = UINT_MAX;
@@ -238,6 +615,9 @@ tty_start_tty(struct tty *tty)
 	tty->rlower = UINT_MAX;
 	tty->rupper = UINT_MAX;
 
+	tty->rleft = UINT_MAX;
+	tty->rright = UINT_MAX;
+
 	tty->mode = MODE_CURSOR;
 
 	tty->flags |= TTY_STARTED;
@@ -257,12 +637,18 @@ tty_set_version(struct tty *tty, u_int version)
 
 		tty_putcode(tty, TTYC_RMACS);
 		memcpy(&tty->cell, &grid_default_cell, sizeof tty->cell);
+		tty_invalidate(tty);
 
 		tty->cx = UINT_MAX;
 		tty->cy = UINT_MAX;
 
 		tty->rupper = UINT_MAX;
 		tty->rlower = UINT_MAX;
+
+		if (tty_use_margin(tty))
+			tty_putcode(tty, TTYC_ENMG);
+		tty->rleft = UINT_MAX;
+		tty->rright = UINT_MAX;
 	}
 }
 
@@ -274,6 +660,7 @@ tty_stop_tty(struct tty *tty)
 	if (!(tty->flags & TTY_STARTED))
 		return;
 	tty->flags &= ~TTY_STARTED;
+	tty_flush(tty);
 
 	bufferevent_disable(tty->event, EV_READ|EV_WRITE);
 
@@ -290,6 +677,8 @@ tty_stop_tty(struct tty *tty)
 	setblocking(tty->fd, 1);
 
 	tty_raw(tty, tty_term_string2(tty->term, TTYC_CSR, 0, ws.ws_row - 1));
+	if (tty_use_margin(tty) && tty_term_has(tty->term, TTYC_DSMG))
+		tty_raw(tty, tty_term_string(tty->term, TTYC_DSMG));
 	if (tty_use_acs(tty))
 		tty_raw(tty, tty_term_string(tty->term, TTYC_RMACS));
 	tty_raw(tty, tty_term_string(tty->term, TTYC_SGR0));
@@ -321,8 +710,7 @@ tty_close(struct tty *tty)
 		tty->log_fd = -1;
 	}
 
-	if (event_initialized(&tty->key_timer))
-		evtimer_del(&tty->key_timer);
+	timer_del(&tty->key_timer);
 	tty_stop_tty(tty);
 
 	if (tty->flags & TTY_OPENED) {
@@ -346,6 +734,8 @@ tty_free(struct tty *tty)
 	tty_close(tty);
 
 	xfree(tty->ccolour);
+	if (tty->shadow != NULL)
+		xfree(tty->shadow);
 	if (tty->path != NULL)
 		xfree(tty->path);
 	if (tty->termname != NULL)
@@ -362,6 +752,7 @@ void
 tty_putcode(struct tty *tty, enum tty_code_code code)
 {
 	tty_puts(tty, tty_term_string(tty->term, code));
+	tty_shadow_code(tty, code);
 }
 
 void
@@ -369,7 +760,9 @@ tty_putcode1(struct tty *tty, enum tty_code_code code, int a)
 {
 	if (a < 0)
 		return;
-	tty_puts(tty, tty_term_string1(tty->term, code, a));
+	if (!tty_putcode_format(tty, code, a, 0))
+		tty_puts(tty, tty_term_string1(tty->term, code, a));
+	tty_shadow_code(tty, code);
 }
 
 void
@@ -377,7 +770,26 @@ tty_putcode2(struct tty *tty, enum tty_code_code code, int a, int b)
 {
 	if (a < 0 || b < 0)
 		return;
-	tty_puts(tty, tty_term_string2(tty->term, code, a, b));
+	if (!tty_putcode_format(tty, code, a, b))
+		tty_puts(tty, tty_term_string2(tty->term, code, a, b));
+}
+
+/* Write a code straight into the output buffer if it doesn't need tparm. */
+int
+tty_putcode_format(struct tty *tty, enum tty_code_code code, u_int a, u_int b)
+{
+	u_char	*ptr;
+	size_t	 size;
+
+	if ((size = tty_term_format_size(tty->term, code)) == 0)
+		return (0);
+	if ((ptr = tty_reserve(tty, size)) == NULL)
+		return (0);
+	size = tty_term_format(tty->term, code, a, b, (char *) ptr, size);
+	if (size == 0)
+		return (0);
+	tty->olen += size;
+	return (1);
 }
 
 void
@@ -394,15 +806,117 @@ tty_putcode_ptr2(struct tty *tty, enum tty_code_code code, const void *a, const
 		tty_puts(tty, tty_term_ptr2(tty->term, code, a, b));
 }
 
+/*
+ * Add output to the staging buffer. It is passed to the bufferevent in one go
+ * when full or at the end of each loop, rather than a byte at a time.
+ */
 void
-tty_puts(struct tty *tty, const char *s)
+tty_add(struct tty *tty, const void *buf, size_t len)
 {
-	if (*s == '\0')
+	u_char	*ptr;
+
+	if ((ptr = tty_reserve(tty, len)) == NULL) {
+		if (tty_backlog(tty, len))
+			return;
+		bufferevent_write(tty->event, buf, len);
+		if (tty->log_fd != -1)
+			write(tty->log_fd, buf, len);
 		return;
-	bufferevent_write(tty->event, s, strlen(s));
+	}
+	memcpy(ptr, buf, len);
+	tty->olen += len;
+}
 
+/*
+ * Make sure there is space for len bytes at the end of the output buffer and
+ * return where they go, or NULL if it will never fit. The caller adds what it
+ * actually used to olen.
+ */
+u_char *
+tty_reserve(struct tty *tty, size_t len)
+{
+	/* Make sure the client is flushed at the end of this loop. */
+	if (tty->client != NULL)
+		server_client_dirty(tty->client);
+
+	/*
+	 * Start a synchronized update with the first output, so the terminal
+	 * shows everything up to the next tty_flush at once.
+	 */
+	if (!(tty->flags & TTY_SYNC) && *tty->term->sync_start != '\0') {
+		tty->flags |= TTY_SYNC;
+		tty_add(tty,
+		    tty->term->sync_start, strlen(tty->term->sync_start));
+	}
+
+	if (tty->olen + len > sizeof tty->obuf)
+		tty_write_buffer(tty);
+	if (len > sizeof tty->obuf)
+		return (NULL);
+	return (tty->obuf + tty->olen);
+}
+
+/* Finish any synchronized update and write the staged output. */
+void
+tty_flush(struct tty *tty)
+{
+	if (tty->flags & TTY_SYNC) {
+		tty_add(tty, tty->term->sync_end, strlen(tty->term->sync_end));
+		tty->flags &= ~TTY_SYNC;
+	}
+	tty_write_buffer(tty);
+}
+
+/* Pass the staged output to the bufferevent. */
+void
+tty_write_buffer(struct tty *tty)
+{
+	if (tty->olen == 0)
+		return;
+	if (tty_backlog(tty, tty->olen)) {
+		tty->olen = 0;
+		return;
+	}
+	bufferevent_write(tty->event, tty->obuf, tty->olen);
 	if (tty->log_fd != -1)
-		write(tty->log_fd, s, strlen(s));
+		write(tty->log_fd, tty->obuf, tty->olen);
+	tty->olen = 0;
+}
+
+/*
+ * Check if output would take the terminal over the backlog limit. If it does,
+ * throw away everything waiting and block it until the terminal is accepting
+ * output again. A cancel character ends any sequence cut off part way.
+ */
+int
+tty_backlog(struct tty *tty, size_t len)
+{
+	struct evbuffer	*evb = tty->event->output;
+	u_int64_t	 limit;
+
+	if (tty->flags & TTY_BLOCK)
+		return (1);
+
+	/* The limit is in kilobytes and may not fit in a size_t. */
+	limit = options_get_number(&global_options, "backlog-limit");
+	if (limit == 0 ||
+	    (u_int64_t) EVBUFFER_LENGTH(evb) + len <= limit * 1024)
+		return (0);
+	log_debug("%s: blocked with %zu bytes waiting", tty->path,
+	    EVBUFFER_LENGTH(evb) + len);
+
+	evbuffer_drain(evb, EVBUFFER_LENGTH(evb));
+	bufferevent_write(tty->event, "\030", 1);
+	tty->flags |= TTY_BLOCK;
+	return (1);
+}
+
+void
+tty_puts(struct tty *tty, const char *s)
+{
+	if (*s == '\0')
+		return;
+	tty_add(tty, s, strlen(s));
 }
 
 void
@@ -414,11 +928,11 @@ tty_putc(struct tty *tty, u_char ch)
 	if (tty->cell.attr & GRID_ATTR_CHARSET) {
 		acs = tty_acs_get(tty, ch);
 		if (acs != NULL)
-			bufferevent_write(tty->event, acs, strlen(acs));
+			tty_add(tty, acs, strlen(acs));
 		else
-			bufferevent_write(tty->event, &ch, 1);
+			tty_add(tty, &ch, 1);
 	} else
-		bufferevent_write(tty->event, &ch, 1);
+		tty_add(tty, &ch, 1);
 
 	if (ch >= 0x20 && ch != 0x7f) {
 		sx = tty->sx;
@@ -426,15 +940,18 @@ tty_putc(struct tty *tty, u_char ch)
 			sx--;
 
 		if (tty->cx >= sx) {
+			if (tty->cy == tty->rlower)
+				tty_shadow_scroll(tty);
 			tty->cx = 1;
 			if (tty->cy != tty->rlower)
 				tty->cy++;
-		} else
+			tty_shadow_putc(tty, 0, tty->cy, ch);
+		} else {
+			tty_shadow_putc(tty, tty->cx, tty->cy, ch);
 			tty->cx++;
-	}
-
-	if (tty->log_fd != -1)
-		write(tty->log_fd, &ch, 1);
+		}
+	} else if (ch == '\n' && tty->cy == tty->rlower)
+		tty_shadow_scroll(tty);
 }
 
 void
@@ -443,9 +960,7 @@ tty_pututf8(struct tty *tty, const struct grid_utf8 *gu)
 	size_t	size;
 
 	size = grid_utf8_size(gu);
-	bufferevent_write(tty->event, gu->data, size);
-	if (tty->log_fd != -1)
-		write(tty->log_fd, gu->data, size);
+	tty_add(tty, gu->data, size);
 	tty->cx += gu->width;
 }
 
@@ -585,7 +1100,7 @@ tty_redraw_region(struct tty *tty, const struct tty_ctx *ctx)
 	 * likely to be followed by some more scrolling.
 	 */
 	if (tty_large_region(tty, ctx)) {
-		wp->flags |= PANE_REDRAW;
+		server_redraw_pane(wp);
 		return;
 	}
 
@@ -598,6 +1113,46 @@ tty_redraw_region(struct tty *tty, const struct tty_ctx *ctx)
 	}
 }
 
+/* Get a cell to draw, in the selection attributes if it is selected. */
+const struct grid_cell *
+tty_draw_get(struct screen *s, u_int px, u_int py, struct grid_cell *tmpgc)
+{
+	const struct grid_cell	*gc;
+
+	gc = grid_view_peek_cell(s->grid, px, py);
+	if (!s->sel.flag || !screen_check_selection(s, px, py))
+		return (gc);
+
+	memcpy(tmpgc, &s->sel.cell, sizeof *tmpgc);
+	tmpgc->data = gc->data;
+	tmpgc->flags = gc->flags & ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
+	tmpgc->flags |= s->sel.cell.flags & (GRID_FLAG_FG256|GRID_FLAG_BG256);
+	return (tmpgc);
+}
+
+/*
+ * Should an unchanged cell be skipped? Short runs are cheaper to write again
+ * than to move the cursor over, unless they run to the end of the line and
+ * there is nothing after them to clear.
+ */
+int
+tty_draw_skip(struct tty *tty, struct screen *s,
+    u_int px, u_int sx, u_int py, u_int ox, u_int oy, int clear)
+{
+	const struct grid_cell	*gc;
+	struct grid_cell	 tmpgc;
+	u_int			 i;
+
+	for (i = px + 1; i < px + TTY_SHADOW_SKIP; i++) {
+		if (i == sx)
+			return (!clear);
+		gc = tty_draw_get(s, i, py, &tmpgc);
+		if (!tty_shadow_same(tty, ox + i, oy + py, gc))
+			return (0);
+	}
+	return (1);
+}
+
 void
 tty_draw_line(struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
 {
@@ -605,13 +1160,15 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
 	struct grid_line	*gl;
 	struct grid_cell	 tmpgc;
 	const struct grid_utf8	*gu;
-	u_int			 i, sx;
+	u_int			 i, sx, ex;
+	int			 wrap, clear;
 
 	tty_update_mode(tty, tty->mode & ~MODE_CURSOR, s);
 
 	sx = screen_size_x(s);
-	if (sx > s->grid->linedata[s->grid->hsize + py].cellsize)
-		sx = s->grid->linedata[s->grid->hsize + py].cellsize;
+	gl = grid_get_line(s->grid, s->grid->hsize + py);
+	if (sx > gl->cellsize)
+		sx = gl->cellsize;
 	if (sx > tty->sx)
 		sx = tty->sx;
 
@@ -621,32 +1178,47 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
 	 */
 	gl = NULL;
 	if (py != 0)
-		gl = &s->grid->linedata[s->grid->hsize + py - 1];
+		gl = grid_get_line(s->grid, s->grid->hsize + py - 1);
+	wrap = 1;
 	if (oy + py == 0 || gl == NULL || !(gl->flags & GRID_LINE_WRAPPED) ||
 	    tty->cx < tty->sx || ox != 0 ||
 	    (oy + py != tty->cy + 1 && tty->cy != s->rlower + oy))
-		tty_cursor(tty, ox, oy + py);
+		wrap = 0;
+
+	/* Nothing to clear if the rest of the line is already blank. */
+	ex = ox + screen_size_x(s);
+	if (ex > tty->sx)
+		ex = tty->sx;
+	clear = 0;
+	for (i = ox + sx; i < ex; i++) {
+		if (!tty_shadow_same(tty, i, oy + py, &grid_default_cell)) {
+			clear = 1;
+			break;
+		}
+	}
 
+	/*
+	 * Only write the cells which differ from what the terminal is already
+	 * showing, moving the cursor over runs of any that are the same.
+	 */
 	for (i = 0; i < sx; i++) {
-		gc = grid_view_peek_cell(s->grid, i, py);
+		gc = tty_draw_get(s, i, py, &tmpgc);
+		if (gc->flags & GRID_FLAG_PADDING)
+			continue;
+
+		if (tty_shadow_same(tty, ox + i, oy + py, gc) &&
+		    tty_draw_skip(tty, s, i, sx, py, ox, oy, clear))
+			continue;
+		if (i != 0 || !wrap)
+			tty_cursor(tty, ox + i, oy + py);
 
 		gu = NULL;
 		if (gc->flags & GRID_FLAG_UTF8)
-			gu = grid_view_peek_utf8(s->grid, i, py);
-
-		if (screen_check_selection(s, i, py)) {
-			memcpy(&tmpgc, &s->sel.cell, sizeof tmpgc);
-			tmpgc.data = gc->data;
-			tmpgc.flags = gc->flags &
-			    ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
-			tmpgc.flags |= s->sel.cell.flags &
-			    (GRID_FLAG_FG256|GRID_FLAG_BG256);
-			tty_cell(tty, &tmpgc, gu);
-		} else
-			tty_cell(tty, gc, gu);
+			gu = grid_utf8_get(gc->data);
+		tty_cell(tty, gc, gu);
 	}
 
-	if (sx >= tty->sx) {
+	if (sx >= tty->sx || !clear) {
 		tty_update_mode(tty, tty->mode, s);
 		return;
 	}
@@ -668,7 +1240,6 @@ tty_write(
 	struct window_pane	*wp = ctx->wp;
 	struct client		*c;
 	struct session		*s;
-	u_int		 	 i;
 
 	/* wp can be NULL if updating the screen but not the terminal. */
 	if (wp == NULL)
@@ -676,12 +1247,17 @@ tty_write(
 
 	if (wp->window->flags & WINDOW_REDRAW || wp->flags & PANE_REDRAW)
 		return;
-	if (!window_pane_visible(wp) || wp->flags & PANE_DROP)
+	if (!window_pane_visible(wp))
 		return;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL)
+	/*
+	 * The window's list is brought up to date once each loop, so the
+	 * client may since have detached or moved to another window.
+	 */
+	tty_writes++;
+	TAILQ_FOREACH(c, &wp->window->clients, window_entry) {
+		tty_write_clients++;
+		if (c->session == NULL)
 			continue;
 		if (c->flags & CLIENT_SUSPENDED)
 			continue;
@@ -690,7 +1266,16 @@ tty_write(
 		if (s->curw->window == wp->window) {
 			if (c->tty.term == NULL)
 				continue;
-			if (c->tty.flags & TTY_FREEZE)
+			if (c->tty.flags & (TTY_FREEZE|TTY_BLOCK))
+				continue;
+			/*
+			 * The selection and raw strings are not part of the
+			 * screen so would be lost by the redraw at the end of
+			 * the frame; always send them.
+			 */
+			if (cmdfn != tty_cmd_setselection &&
+			    cmdfn != tty_cmd_rawstring &&
+			    server_client_hold(c))
 				continue;
 
 			ctx->xoff = wp->xoff;
@@ -718,6 +1303,7 @@ tty_cra_pane(struct tty *tty, const struct tty_ctx *ctx,
 		 ctx->yoff + tt + 1,
 		 ctx->xoff + tl + 1);
 	tty_puts(tty, tmp);
+	tty_invalidate(tty);
 }
 
 void
@@ -733,6 +1319,7 @@ tty_era_pane(struct tty *tty, const struct tty_ctx *ctx,
 		 ctx->yoff + b + 1,
 		 ctx->xoff + r + 1);
 	tty_puts(tty, tmp);
+	tty_invalidate(tty);
 }
 
 void
@@ -780,7 +1367,7 @@ tty_cmd_deletecharacter(struct tty *tty, const struct tty_ctx *ctx)
 void
 tty_cmd_insertline(struct tty *tty, const struct tty_ctx *ctx)
 {
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR) ||
 	    !tty_term_has(tty->term, TTYC_IL1)) {
 		tty_redraw_region(tty, ctx);
@@ -790,15 +1377,17 @@ tty_cmd_insertline(struct tty *tty, const struct tty_ctx *ctx)
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
+	tty_margin_pane(tty, ctx);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
 
 	tty_emulate_repeat(tty, TTYC_IL, TTYC_IL1, ctx->num);
+	tty_margin_off(tty);
 }
 
 void
 tty_cmd_deleteline(struct tty *tty, const struct tty_ctx *ctx)
 {
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR) ||
 	    !tty_term_has(tty->term, TTYC_DL1)) {
 		tty_redraw_region(tty, ctx);
@@ -808,9 +1397,11 @@ tty_cmd_deleteline(struct tty *tty, const struct tty_ctx *ctx)
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
+	tty_margin_pane(tty, ctx);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
 
 	tty_emulate_repeat(tty, TTYC_DL, TTYC_DL1, ctx->num);
+	tty_margin_off(tty);
 }
 
 void
@@ -865,7 +1456,7 @@ tty_cmd_reverseindex(struct tty *tty, const struct tty_ctx *ctx)
 	if (ctx->ocy != ctx->orupper)
 		return;
 
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR) ||
 	    !tty_term_has(tty->term, TTYC_RI)) {
 		tty_redraw_region(tty, ctx);
@@ -875,9 +1466,11 @@ tty_cmd_reverseindex(struct tty *tty, const struct tty_ctx *ctx)
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
+	tty_margin_pane(tty, ctx);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->orupper);
 
 	tty_putcode(tty, TTYC_RI);
+	tty_margin_off(tty);
 }
 
 void
@@ -885,14 +1478,15 @@ tty_cmd_linefeed(struct tty *tty, const struct tty_ctx *ctx)
 {
 	struct window_pane	*wp = ctx->wp;
 	struct screen		*s = wp->screen;
+	u_int			 cx;
 
 	if (ctx->ocy != ctx->orlower)
 		return;
 
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR)) {
 		if (tty_large_region(tty, ctx))
-			wp->flags |= PANE_REDRAW;
+			server_redraw_pane(wp);
 		else if (tty_use_rect(tty)) {
 			tty_cra_pane (tty, ctx, ctx->orupper + 1, 0,
 			    ctx->orlower, screen_size_x(s) - 1,
@@ -908,15 +1502,26 @@ tty_cmd_linefeed(struct tty *tty, const struct tty_ctx *ctx)
 	 * anything - the cursor can just be moved to the last cell and wrap
 	 * naturally.
 	 */
-	if (ctx->num && !(tty->term->flags & TERM_EARLYWRAP))
+	if (tty_pane_full_width(tty, ctx) &&
+	    ctx->num && !(tty->term->flags & TERM_EARLYWRAP))
 		return;
 
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
-	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+	tty_margin_pane(tty, ctx);
+
+	/*
+	 * The terminal only scrolls inside the margins if the cursor is inside
+	 * them, so move it back if it is waiting to wrap after the last cell.
+	 */
+	cx = ctx->ocx;
+	if (!tty_pane_full_width(tty, ctx) && cx > screen_size_x(s) - 1)
+		cx = screen_size_x(s) - 1;
+	tty_cursor_pane(tty, ctx, cx, ctx->ocy);
 
 	tty_putc(tty, '\n');
+	tty_margin_off(tty);
 }
 
 void
@@ -1072,6 +1677,15 @@ tty_cmd_cell(struct tty *tty, const struct tty_ctx *ctx)
 	tty_cell(tty, ctx->cell, ctx->utf8);
 }
 
+void
+tty_cmd_cells(struct tty *tty, const struct tty_ctx *ctx)
+{
+	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
+	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+
+	tty_cells(tty, ctx->cells, ctx->num);
+}
+
 void
 tty_cmd_utf8character(struct tty *tty, const struct tty_ctx *ctx)
 {
@@ -1110,13 +1724,32 @@ tty_cmd_rawstring(struct tty *tty, const struct tty_ctx *ctx)
 
 	for (i = 0; i < ctx->num; i++)
 		tty_putc(tty, str[i]);
+	tty_invalidate(tty);
+}
+
+/* Draw a run of cells from one line. */
+void
+tty_cells(struct tty *tty, const struct grid_cell *cells, u_int n)
+{
+	const struct grid_cell	*gc;
+	const struct grid_utf8	*gu;
+	u_int			 i;
+
+	for (i = 0; i < n; i++) {
+		gc = &cells[i];
+
+		gu = NULL;
+		if (gc->flags & GRID_FLAG_UTF8)
+			gu = grid_utf8_get(gc->data);
+		tty_cell(tty, gc, gu);
+	}
 }
 
 void
 tty_cell(
     struct tty *tty, const struct grid_cell *gc, const struct grid_utf8 *gu)
 {
-	u_int	i;
+	u_int	i, cx = tty->cx, cy = tty->cy;
 
 	/* Skip last character if terminal is stupid. */
 	if (tty->term->flags & TERM_EARLYWRAP &&
@@ -1135,18 +1768,21 @@ tty_cell(
 		if (gc->data < 0x20 || gc->data == 0x7f)
 			return;
 		tty_putc(tty, gc->data);
-		return;
-	}
-
-	/* If the terminal doesn't support UTF-8, write underscores. */
-	if (!(tty->flags & TTY_UTF8)) {
+	} else if (!(tty->flags & TTY_UTF8)) {
+		/* If the terminal doesn't support UTF-8, write underscores. */
 		for (i = 0; i < gu->width; i++)
 			tty_putc(tty, '_');
-		return;
+	} else {
+		/* Otherwise, write UTF-8. */
+		tty_pututf8(tty, gu);
 	}
 
-	/* Otherwise, write UTF-8. */
-	tty_pututf8(tty, gu);
+	/*
+	 * Record the cell in the shadow, unless it wrapped onto the next line
+	 * and tty_putc has already dealt with it.
+	 */
+	if (cx < tty->sx)
+		tty_shadow_set(tty, cx, cy, gc);
 }
 
 void
@@ -1196,6 +1832,48 @@ tty_region(struct tty *tty, u_int rupper, u_int rlower)
 	tty_cursor(tty, 0, 0);
 }
 
+/* Turn off left and right margins. */
+void
+tty_margin_off(struct tty *tty)
+{
+	tty_margin(tty, 0, tty->sx - 1);
+}
+
+/* Set left and right margins to the edges of the pane. */
+void
+tty_margin_pane(struct tty *tty, const struct tty_ctx *ctx)
+{
+	tty_margin(tty,
+	    ctx->xoff, ctx->xoff + screen_size_x(ctx->wp->screen) - 1);
+}
+
+/*
+ * Set left and right margins at absolute position. They are only set while
+ * scrolling a pane and turned off again straight away, as they change where
+ * the terminal wraps and where a carriage return goes.
+ */
+void
+tty_margin(struct tty *tty, u_int rleft, u_int rright)
+{
+	if (!tty_use_margin(tty))
+		return;
+	if (tty->rleft == rleft && tty->rright == rright)
+		return;
+
+	tty->rleft = rleft;
+	tty->rright = rright;
+
+	if (rleft == 0 && rright == tty->sx - 1 &&
+	    tty_term_has(tty->term, TTYC_CLMG))
+		tty_putcode(tty, TTYC_CLMG);
+	else
+		tty_putcode2(tty, TTYC_CMG, rleft, rright);
+
+	/* Setting the margins moves the cursor home. */
+	tty->cx = 0;
+	tty->cy = 0;
+}
+
 /* Move cursor inside pane. */
 void
 tty_cursor_pane(struct tty *tty, const struct tty_ctx *ctx, u_int cx, u_int cy)
@@ -1203,123 +1881,266 @@ tty_cursor_pane(struct tty *tty, const struct tty_ctx *ctx, u_int cx, u_int cy)
 	tty_cursor(tty, ctx->xoff + cx, ctx->yoff + cy);
 }
 
-/* Move cursor to absolute position. */
+/* Number of decimal digits in a parameter. */
+u_int
+tty_move_digits(u_int n)
+{
+	u_int	digits;
+
+	for (digits = 1; n >= 10; digits++)
+		n /= 10;
+	return (digits);
+}
+
+/* Try moving the cursor with a step, keeping it if it is the cheapest. */
 void
-tty_cursor(struct tty *tty, u_int cx, u_int cy)
+tty_move_try(struct tty *tty, struct tty_move *m, enum tty_move_type type,
+    enum tty_code_code code, u_int n)
 {
 	struct tty_term	*term = tty->term;
-	u_int		 thisx, thisy;
-	int		 change;
-
-	if (cx > tty->sx - 1)
-		cx = tty->sx - 1;
+	u_int		 cost, each;
+
+	switch (type) {
+	case TTY_MOVE_NONE:
+		cost = 0;
+		break;
+	case TTY_MOVE_LF:
+	case TTY_MOVE_PRINT:
+		cost = n;
+		break;
+	case TTY_MOVE_REPEAT:
+		if ((each = term->move_cost[code]) == UINT_MAX)
+			return;
+		cost = each * n;
+		break;
+	case TTY_MOVE_RELATIVE:
+	case TTY_MOVE_ABSOLUTE:
+		if ((each = term->move_cost[code]) == UINT_MAX)
+			return;
+		if (type == TTY_MOVE_ABSOLUTE)
+			cost = each - 1 + tty_move_digits(n + 1);
+		else
+			cost = each - 1 + tty_move_digits(n);
+		break;
+	default:
+		return;
+	}
+	if (cost >= m->cost)
+		return;
 
-	thisx = tty->cx;
-	thisy = tty->cy;
+	m->type = type;
+	m->code = code;
+	m->n = n;
+	m->cost = cost;
+}
 
-	/* No change. */
-	if (cx == thisx && cy == thisy)
-		return;
+/*
+ * Can the cells between two columns be written again to move the cursor over
+ * them? They must be known and plain ASCII in the current attributes.
+ */
+int
+tty_move_print(struct tty *tty, u_int px, u_int nx, u_int py)
+{
+	const struct grid_cell	*gc, *tc = &tty->cell;
+	u_int			 xx;
 
-	/* Very end of the line, just use absolute movement. */
-	if (thisx > tty->sx - 1)
-		goto absolute;
+	if (tty->shadow == NULL || nx > TTY_MOVE_PRINT_MAX)
+		return (0);
+	if (tc->attr & GRID_ATTR_CHARSET)
+		return (0);
 
-	/* Move to home position (0, 0). */
-	if (cx == 0 && cy == 0 && tty_term_has(term, TTYC_HOME)) {
-		tty_putcode(tty, TTYC_HOME);
-		goto out;
+	for (xx = px; xx < px + nx; xx++) {
+		gc = tty_shadow_cell(tty, xx, py);
+		if (gc->flags & (GRID_FLAG_UTF8|GRID_FLAG_PADDING))
+			return (0);
+		if (gc->data < 0x20 || gc->data > 0x7e)
+			return (0);
+		if (gc->attr != tc->attr || gc->flags != tc->flags ||
+		    gc->fg != tc->fg || gc->bg != tc->bg)
+			return (0);
 	}
+	return (1);
+}
 
-	/* Zero on the next line. */
-	if (cx == 0 && cy == thisy + 1 && thisy != tty->rlower) {
-		tty_putc(tty, '\r');
-		tty_putc(tty, '\n');
-		goto out;
-	}
+/* Find the cheapest way to move right along a line, maybe using tabs. */
+void
+tty_move_right(
+    struct tty *tty, u_int px, u_int cx, u_int py, struct tty_move *m)
+{
+	struct tty_move	rest;
+	u_int		n = cx - px, tx, tabs;
 
-	/* Moving column or row. */
-	if (cy == thisy) {
-		/*
-		 * Moving column only, row staying the same.
-		 */
+	tty_move_try(tty, m, TTY_MOVE_REPEAT, TTYC_CUF1, n);
+	tty_move_try(tty, m, TTY_MOVE_RELATIVE, TTYC_CUF, n);
+	if (tty_move_print(tty, px, n, py))
+		tty_move_try(tty, m, TTY_MOVE_PRINT, 0, n);
 
-		/* To left edge. */
-		if (cx == 0)	{
-			tty_putc(tty, '\r');
-			goto out;
-		}
+	/*
+	 * Tabs can be used to reach the last tab stop before the column if
+	 * they are known to be every eight columns.
+	 */
+	if (tty_term_number(tty->term, TTYC_IT) != 8)
+		return;
+	tx = cx & ~7;
+	if (tx <= px || tty->term->move_cost[TTYC_HT] == UINT_MAX)
+		return;
+	tabs = (tx / 8) - (px / 8);
 
-		/* One to the left. */
-		if (cx == thisx - 1 && tty_term_has(term, TTYC_CUB1)) {
-			tty_putcode(tty, TTYC_CUB1);
-			goto out;
-		}
+	memset(&rest, 0, sizeof rest);
+	rest.cost = UINT_MAX;
+	if (tx == cx)
+		tty_move_try(tty, &rest, TTY_MOVE_NONE, 0, 0);
+	else {
+		tty_move_try(tty, &rest, TTY_MOVE_REPEAT, TTYC_CUF1, cx - tx);
+		tty_move_try(tty, &rest, TTY_MOVE_RELATIVE, TTYC_CUF, cx - tx);
+		if (tty_move_print(tty, tx, cx - tx, py))
+			tty_move_try(tty, &rest, TTY_MOVE_PRINT, 0, cx - tx);
+	}
+	if (rest.cost == UINT_MAX)
+		return;
+	rest.tabs = tabs;
+	rest.cost += tabs * tty->term->move_cost[TTYC_HT];
+	if (rest.cost < m->cost)
+		memcpy(m, &rest, sizeof *m);
+}
 
-		/* One to the right. */
-		if (cx == thisx + 1 && tty_term_has(term, TTYC_CUF1)) {
-			tty_putcode(tty, TTYC_CUF1);
-			goto out;
+/* Write a step of a cursor movement. */
+void
+tty_move_put(struct tty *tty, struct tty_move *m, u_int cx, u_int cy)
+{
+	u_int	i;
+	u_char	ch;
+
+	for (i = 0; i < m->tabs; i++)
+		tty_putcode(tty, TTYC_HT);
+
+	switch (m->type) {
+	case TTY_MOVE_NONE:
+		break;
+	case TTY_MOVE_LF:
+		for (i = 0; i < m->n; i++)
+			tty_add(tty, "\n", 1);
+		break;
+	case TTY_MOVE_REPEAT:
+		for (i = 0; i < m->n; i++)
+			tty_putcode(tty, m->code);
+		break;
+	case TTY_MOVE_RELATIVE:
+	case TTY_MOVE_ABSOLUTE:
+		tty_putcode1(tty, m->code, m->n);
+		break;
+	case TTY_MOVE_PRINT:
+		for (i = cx - m->n; i < cx; i++) {
+			ch = tty_shadow_cell(tty, i, cy)->data;
+			tty_add(tty, &ch, 1);
 		}
+		break;
+	}
+}
 
-		/* Calculate difference. */
-		change = thisx - cx;	/* +ve left, -ve right */
+/*
+ * Move the cursor. The row and the column are moved separately, each in
+ * whichever way is shortest for this terminal, and the total compared with
+ * moving to an absolute position.
+ */
+void
+tty_cursor(struct tty *tty, u_int cx, u_int cy)
+{
+	struct tty_term	*term = tty->term;
+	struct tty_move	 row, col, cr;
+	u_int		 thisx, thisy, cost;
 
-		/*
-		 * Use HPA if change is larger than absolute, otherwise move
-		 * the cursor with CUB/CUF.
-		 */
-		if ((u_int) abs(change) > cx && tty_term_has(term, TTYC_HPA)) {
-			tty_putcode1(tty, TTYC_HPA, cx);
-			goto out;
-		} else if (change > 0 && tty_term_has(term, TTYC_CUB)) {
-			tty_putcode1(tty, TTYC_CUB, change);
-			goto out;
-		} else if (change < 0 && tty_term_has(term, TTYC_CUF)) {
-			tty_putcode1(tty, TTYC_CUF, -change);
-			goto out;
-		}
-	} else if (cx == thisx) {
-		/*
-		 * Moving row only, column staying the same.
-		 */
+	if (cx > tty->sx - 1)
+		cx = tty->sx - 1;
 
-		/* One above. */
-		if (thisy != tty->rupper &&
-		    cy == thisy - 1 && tty_term_has(term, TTYC_CUU1)) {
-			tty_putcode(tty, TTYC_CUU1);
-			goto out;
-		}
+	thisx = tty->cx;
+	thisy = tty->cy;
 
-		/* One below. */
-		if (thisy != tty->rlower &&
-		    cy == thisy + 1 && tty_term_has(term, TTYC_CUD1)) {
-			tty_putcode(tty, TTYC_CUD1);
-			goto out;
-		}
+	/* No change. */
+	if (cx == thisx && cy == thisy)
+		return;
 
-		/* Calculate difference. */
-		change = thisy - cy;	/* +ve up, -ve down */
+	/*
+	 * Very end of the line or position not known, just use absolute
+	 * movement.
+	 */
+	if (thisx > tty->sx - 1 || thisy > tty->sy - 1)
+		goto absolute;
 
-		/*
-		 * Try to use VPA if change is larger than absolute or if this
-		 * change would cross the scroll region, otherwise use CUU/CUD.
-		 */
-		if ((u_int) abs(change) > cy ||
-		    (change < 0 && cy - change > tty->rlower) ||
-		    (change > 0 && cy - change < tty->rupper)) {
-			    if (tty_term_has(term, TTYC_VPA)) {
-				    tty_putcode1(tty, TTYC_VPA, cy);
-				    goto out;
-			    }
-		} else if (change > 0 && tty_term_has(term, TTYC_CUU)) {
-			tty_putcode1(tty, TTYC_CUU, change);
-			goto out;
-		} else if (change < 0 && tty_term_has(term, TTYC_CUD)) {
-			tty_putcode1(tty, TTYC_CUD, -change);
-			goto out;
+	memset(&row, 0, sizeof row);
+	row.cost = UINT_MAX;
+	if (cy == thisy)
+		tty_move_try(tty, &row, TTY_MOVE_NONE, 0, 0);
+	else if (cy > thisy) {
+		/* Don't move down past the bottom of the scroll region. */
+		if (thisy > tty->rlower || cy <= tty->rlower) {
+			tty_move_try(tty, &row, TTY_MOVE_LF, 0, cy - thisy);
+			tty_move_try(tty, &row, TTY_MOVE_REPEAT, TTYC_CUD1,
+			    cy - thisy);
+			tty_move_try(tty, &row, TTY_MOVE_RELATIVE, TTYC_CUD,
+			    cy - thisy);
+		}
+	} else {
+		/* Or up past the top. */
+		if (thisy < tty->rupper || cy >= tty->rupper) {
+			tty_move_try(tty, &row, TTY_MOVE_REPEAT, TTYC_CUU1,
+			    thisy - cy);
+			tty_move_try(tty, &row, TTY_MOVE_RELATIVE, TTYC_CUU,
+			    thisy - cy);
 		}
 	}
+	if (cy != thisy)
+		tty_move_try(tty, &row, TTY_MOVE_ABSOLUTE, TTYC_VPA, cy);
+
+	memset(&col, 0, sizeof col);
+	col.cost = UINT_MAX;
+	if (cx == thisx)
+		tty_move_try(tty, &col, TTY_MOVE_NONE, 0, 0);
+	else if (cx < thisx) {
+		tty_move_try(tty, &col, TTY_MOVE_REPEAT, TTYC_CUB1, thisx - cx);
+		tty_move_try(tty, &col, TTY_MOVE_RELATIVE, TTYC_CUB,
+		    thisx - cx);
+	} else
+		tty_move_right(tty, thisx, cx, cy, &col);
+	if (cx != thisx)
+		tty_move_try(tty, &col, TTY_MOVE_ABSOLUTE, TTYC_HPA, cx);
+
+	/* Also try a carriage return first then moving right. */
+	memset(&cr, 0, sizeof cr);
+	cr.cost = UINT_MAX;
+	if (cx == 0)
+		tty_move_try(tty, &cr, TTY_MOVE_NONE, 0, 0);
+	else
+		tty_move_right(tty, 0, cx, cy, &cr);
+	if (cr.cost != UINT_MAX && cr.cost + 1 < col.cost)
+		col.cr = 1;
+	else
+		cr.cost = UINT_MAX;
+
+	if (row.cost == UINT_MAX || col.cost == UINT_MAX)
+		goto absolute;
+	if (col.cr)
+		cost = row.cost + 1 + cr.cost;
+	else
+		cost = row.cost + col.cost;
+
+	/* Use home or absolute movement if it is no longer. */
+	if (cx == 0 && cy == 0 && term->move_cost[TTYC_HOME] <= cost) {
+		tty_putcode(tty, TTYC_HOME);
+		goto out;
+	}
+	if (term->move_cost[TTYC_CUP] - 2 + tty_move_digits(cy + 1) +
+	    tty_move_digits(cx + 1) < cost)
+		goto absolute;
+
+	if (col.cr)
+		tty_add(tty, "\r", 1);
+	tty_move_put(tty, &row, cx, cy);
+	if (col.cr)
+		tty_move_put(tty, &cr, cx, cy);
+	else
+		tty_move_put(tty, &col, cx, cy);
+	goto out;
 
 absolute:
 	/* Absolute movement. */
@@ -1357,6 +2178,10 @@ tty_attributes(struct tty *tty, const struct grid_cell *gc)
 	tty_check_fg(tty, &gc2);
 	tty_check_bg(tty, &gc2);
 
+	/* Put everything into one sequence if the terminal allows. */
+	if (tty->term->flags & TERM_SGR && tty_sgr(tty, &gc2) == 0)
+		return;
+
 	/* If any bits are being cleared, reset everything. */
 	if (tc->attr & ~gc2.attr)
 		tty_reset(tty);
@@ -1399,6 +2224,205 @@ tty_attributes(struct tty *tty, const struct grid_cell *gc)
 		tty_putcode(tty, TTYC_SMACS);
 }
 
+/* Empty the SGR cache, when the terminal changes. */
+void
+tty_sgr_clear(struct tty *tty)
+{
+	u_int	i;
+
+	TAILQ_INIT(&tty->sgr_list);
+	for (i = 0; i < TTY_SGR_ENTRIES; i++) {
+		tty->sgr[i].key = (u_int64_t) -1;
+		TAILQ_INSERT_TAIL(&tty->sgr_list, &tty->sgr[i], entry);
+	}
+}
+
+/* Add a parameter to an SGR sequence. */
+void
+tty_sgr_add(char *buf, size_t len, size_t *off, const char *fmt, ...)
+{
+	va_list	ap;
+
+	if (*off > 2 && *off < len)
+		buf[(*off)++] = ';';
+	if (*off >= len)
+		return;
+	va_start(ap, fmt);
+	*off += xvsnprintf(buf + *off, len - *off, fmt, ap);
+	va_end(ap);
+}
+
+/*
+ * Build one SGR sequence to change the terminal from the attributes and
+ * colours of one cell to another, returning its length. If reset is set, the
+ * sequence starts by resetting everything. Otherwise, returns -1 if something
+ * must be cleared that the terminal can only clear with a reset. Also returns
+ * -1 if the sequence does not fit. The character set is not set with SGR so
+ * is ignored.
+ */
+int
+tty_sgr_encode(struct tty *tty, const struct grid_cell *from,
+    const struct grid_cell *to, int reset, char *buf, size_t len)
+{
+	struct tty_term	*term = tty->term;
+	u_char		 attr, to_attr, fg, bg, flags;
+	size_t		 off;
+	u_int		 i;
+
+	off = xsnprintf(buf, len, "\033[");
+	if (reset) {
+		tty_sgr_add(buf, len, &off, "0");
+		attr = 0;
+		fg = bg = 8;
+		flags = 0;
+	} else {
+		attr = from->attr & ~GRID_ATTR_CHARSET;
+		fg = from->fg;
+		bg = from->bg;
+		flags = from->flags;
+	}
+
+	to_attr = to->attr & ~GRID_ATTR_CHARSET;
+	for (i = 0; i < nitems(term->sgr_on); i++) {
+		if ((attr & ~to_attr) & (1 << i)) {
+			if (term->sgr_off[i] == 0)
+				return (-1);
+			tty_sgr_add(buf, len, &off, "%u", term->sgr_off[i]);
+		} else if ((to_attr & ~attr) & (1 << i)) {
+			if (term->sgr_on[i] != 0) {
+				tty_sgr_add(buf, len, &off, "%u",
+				    term->sgr_on[i]);
+			}
+		}
+	}
+
+	/* The colours have already been fixed up by tty_check_fg and _bg. */
+	if (to->fg != fg || ((to->flags ^ flags) & GRID_FLAG_FG256)) {
+		if (to->flags & GRID_FLAG_FG256) {
+			if ((term->flags|tty->term_flags) & TERM_256COLOURS) {
+				tty_sgr_add(buf, len, &off, "38;5;%hhu",
+				    to->fg);
+			} else {
+				tty_sgr_add(buf, len, &off, "38;5;%hhu",
+				    colour_256to88(to->fg));
+			}
+		} else if (to->fg == 8) {
+			if (!tty_term_has(term, TTYC_AX))
+				return (-1);
+			tty_sgr_add(buf, len, &off, "39");
+		} else if (to->fg >= 90 && to->fg <= 97)
+			tty_sgr_add(buf, len, &off, "%hhu", to->fg);
+		else
+			tty_sgr_add(buf, len, &off, "3%hhu", to->fg);
+	}
+	if (to->bg != bg || ((to->flags ^ flags) & GRID_FLAG_BG256)) {
+		if (to->flags & GRID_FLAG_BG256) {
+			if ((term->flags|tty->term_flags) & TERM_256COLOURS) {
+				tty_sgr_add(buf, len, &off, "48;5;%hhu",
+				    to->bg);
+			} else {
+				tty_sgr_add(buf, len, &off, "48;5;%hhu",
+				    colour_256to88(to->bg));
+			}
+		} else if (to->bg == 8) {
+			if (!tty_term_has(term, TTYC_AX))
+				return (-1);
+			tty_sgr_add(buf, len, &off, "49");
+		} else if (to->bg >= 90 && to->bg <= 97)
+			tty_sgr_add(buf, len, &off, "%u", to->bg + 10);
+		else
+			tty_sgr_add(buf, len, &off, "4%hhu", to->bg);
+	}
+
+	if (off == 2)
+		return (0);
+	if (off + 1 >= len)
+		return (-1);
+	buf[off++] = 'm';
+	buf[off] = '\0';
+	return (off);
+}
+
+/*
+ * Change the attributes and colours with the shortest SGR sequence. Sequences
+ * are kept in a small cache with the most recently used first, since the same
+ * few changes tend to be made over and over. Returns -1 if no sequence fits,
+ * leaving the terminal unchanged.
+ */
+int
+tty_sgr(struct tty *tty, const struct grid_cell *gc)
+{
+	struct grid_cell	*tc = &tty->cell;
+	struct tty_sgr		*sgr;
+	char			 buf[sizeof sgr->s];
+	u_int64_t		 key;
+	u_char			 attr, flags;
+	int			 n, n2;
+
+	attr = gc->attr & ~GRID_ATTR_CHARSET;
+	flags = gc->flags & (GRID_FLAG_FG256|GRID_FLAG_BG256);
+	if (attr == (tc->attr & ~GRID_ATTR_CHARSET) && gc->fg == tc->fg &&
+	    gc->bg == tc->bg &&
+	    flags == (tc->flags & (GRID_FLAG_FG256|GRID_FLAG_BG256)))
+		sgr = NULL;
+	else {
+		key = (u_int64_t) attr << 56 | (u_int64_t) gc->fg << 48 |
+		    (u_int64_t) gc->bg << 40 | (u_int64_t) flags << 32;
+		key |= (tc->attr & ~GRID_ATTR_CHARSET) << 24 | tc->fg << 16 |
+		    tc->bg << 8 |
+		    (tc->flags & (GRID_FLAG_FG256|GRID_FLAG_BG256));
+
+		TAILQ_FOREACH(sgr, &tty->sgr_list, entry) {
+			if (sgr->key == key)
+				break;
+		}
+		if (sgr == NULL) {
+			/*
+			 * Reuse the least recently used and pick the shorter
+			 * way.
+			 */
+			sgr = TAILQ_LAST(&tty->sgr_list, tty_sgrs);
+			n = tty_sgr_encode(tty, tc, gc, 0, sgr->s,
+			    sizeof sgr->s);
+			n2 = tty_sgr_encode(tty, tc, gc, 1, buf, sizeof buf);
+			if (n2 == -1 && n == -1) {
+				sgr->key = (u_int64_t) -1;
+				sgr->len = 0;
+				return (-1);
+			}
+			if (n == -1 || (n2 != -1 && n2 < n)) {
+				memcpy(sgr->s, buf, n2);
+				n = n2;
+			}
+			sgr->key = key;
+			sgr->len = n;
+		}
+	}
+
+	/* The character set is changed with its own codes. */
+	if ((tc->attr ^ gc->attr) & GRID_ATTR_CHARSET && tty_use_acs(tty)) {
+		if (gc->attr & GRID_ATTR_CHARSET)
+			tty_putcode(tty, TTYC_SMACS);
+		else
+			tty_putcode(tty, TTYC_RMACS);
+	}
+	tc->attr = gc->attr;
+	if (sgr == NULL)
+		return (0);
+
+	if (sgr != TAILQ_FIRST(&tty->sgr_list)) {
+		TAILQ_REMOVE(&tty->sgr_list, sgr, entry);
+		TAILQ_INSERT_HEAD(&tty->sgr_list, sgr, entry);
+	}
+	tty_add(tty, sgr->s, sgr->len);
+
+	tc->fg = gc->fg;
+	tc->bg = gc->bg;
+	tc->flags &= ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
+	tc->flags |= flags;
+	return (0);
+}
+
 void
 tty_colours(struct tty *tty, const struct grid_cell *gc)
 {
@@ -144,7 +144,7 @@ struct window_copy_mode_data {
 	char	       *searchstr;
 
 	enum window_copy_input_type jumptype;
-	char		jumpchar;
+	u_char		jumpchar;
 };
 
 struct screen *
@@ -909,24 +909,14 @@ window_copy_search_compare(
     struct grid *gd, u_int px, u_int py, struct grid *sgd, u_int spx)
 {
 	const struct grid_cell	*gc, *sgc;
-	const struct grid_utf8	*gu, *sgu;
 
 	gc = grid_peek_cell(gd, px, py);
 	sgc = grid_peek_cell(sgd, spx, 0);
 
+	/* For UTF-8 cells, data is the index in the UTF-8 table. */
 	if ((gc->flags & GRID_FLAG_UTF8) != (sgc->flags & GRID_FLAG_UTF8))
 		return (0);
-
-	if (gc->flags & GRID_FLAG_UTF8) {
-		gu = grid_peek_utf8(gd, px, py);
-		sgu = grid_peek_utf8(sgd, spx, 0);
-		if (grid_utf8_compare(gu, sgu))
-			return (1);
-	} else {
-		if (gc->data == sgc->data)
-			return (1);
-	}
-	return (0);
+	return (gc->data == sgc->data);
 }
 
 int
@@ -1414,7 +1404,7 @@ window_copy_copy_line(struct window_pane *wp,
 	 * Work out if the line was wrapped at the screen edge and all of it is
 	 * on screen.
 	 */
-	gl = &gd->linedata[sy];
+	gl = grid_get_line(gd, sy);
 	if (gl->flags & GRID_LINE_WRAPPED && gl->cellsize <= gd->sx)
 		wrapped = 1;
 
@@ -1494,7 +1484,7 @@ window_copy_find_length(struct window_pane *wp, u_int py)
 	 * width of the grid, and screen_write_copy treats them as spaces, so
 	 * ignore them here too.
 	 */
-	px = s->grid->linedata[py].cellsize;
+	px = grid_get_line(s->grid, py)->cellsize;
 	if (px > screen_size_x(s))
 		px = screen_size_x(s);
 	while (px > 0) {
@@ -1518,7 +1508,8 @@ window_copy_cursor_start_of_line(struct window_pane *wp)
 
 	if (data->cx == 0) {
 		py = screen_hsize(back_s) + data->cy - data->oy;
-		while (py > 0 && gd->linedata[py-1].flags & GRID_LINE_WRAPPED) {
+		while (py > 0 &&
+		    grid_get_line(gd, py - 1)->flags & GRID_LINE_WRAPPED) {
 			window_copy_cursor_up(wp, 0);
 			py = screen_hsize(back_s) + data->cy - data->oy;
 		}
@@ -1567,9 +1558,9 @@ window_copy_cursor_end_of_line(struct window_pane *wp)
 	if (data->cx == px) {
 		if (data->screen.sel.flag && data->rectflag)
 			px = screen_size_x(back_s);
-		if (gd->linedata[py].flags & GRID_LINE_WRAPPED) {
+		if (grid_get_line(gd, py)->flags & GRID_LINE_WRAPPED) {
 			while (py < gd->sy + gd->hsize &&
-			    gd->linedata[py].flags & GRID_LINE_WRAPPED) {
+			    grid_get_line(gd, py)->flags & GRID_LINE_WRAPPED) {
 				window_copy_cursor_down(wp, 0);
 				py = screen_hsize(back_s)
 				     + data->cy - data->oy;
@@ -58,7 +58,6 @@ struct window_pane_tree all_window_panes;
 u_int	next_window_pane_id;
 u_int	next_window_id;
 
-void	window_pane_timer_callback(int, short, void *);
 void	window_pane_read_callback(struct bufferevent *, void *);
 void	window_pane_error_callback(struct bufferevent *, short, void *);
 
@@ -167,7 +166,9 @@ void
 winlink_set_window(struct winlink *wl, struct window *w)
 {
 	wl->window = w;
+	TAILQ_INSERT_TAIL(&w->winlinks, wl, wentry);
 	w->references++;
+	resize_queue_window(w);
 }
 
 void
@@ -176,6 +177,12 @@ winlink_remove(struct winlinks *wwl, struct winlink *wl)
 	struct window	*w = wl->window;
 
 	RB_REMOVE(winlinks, wwl, wl);
+	if (w != NULL) {
+		TAILQ_REMOVE(&w->winlinks, wl, wentry);
+		if (wl->session->sizew == w)
+			wl->session->sizew = NULL;
+		resize_queue_window(w);
+	}
 	if (wl->status_text != NULL)
 		xfree(wl->status_text);
 	xfree(wl);
@@ -291,6 +298,9 @@ window_create1(u_int sx, u_int sy)
 	w->layout_root = NULL;
 	TAILQ_INIT(&w->layout_list);
 
+	TAILQ_INIT(&w->clients);
+	TAILQ_INIT(&w->winlinks);
+
 	w->sx = sx;
 	w->sy = sy;
 
@@ -346,11 +356,16 @@ window_destroy(struct window *w)
 	while (!ARRAY_EMPTY(&windows) && ARRAY_LAST(&windows) == NULL)
 		ARRAY_TRUNC(&windows, 1);
 
+	while (!TAILQ_EMPTY(&w->clients))
+		server_client_set_window(TAILQ_FIRST(&w->clients), NULL);
+
 	if (w->layout_root != NULL)
 		layout_free(w);
 
-	if (event_initialized(&w->name_timer))
-		evtimer_del(&w->name_timer);
+	cancel_window_name(w);
+	server_window_cancel_alerts(w);
+	server_client_cancel_redraw(w);
+	resize_cancel_window(w);
 
 	options_free(&w->options);
 
@@ -618,6 +633,9 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 	wp->fd = -1;
 	wp->event = NULL;
 
+	wp->name_pgrp = -1;
+	wp->name_cmd = NULL;
+
 	wp->mode = NULL;
 
 	wp->layout_cell = NULL;
@@ -636,6 +654,8 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 
 	screen_init(&wp->base, sx, sy, hlimit);
 	wp->screen = &wp->base;
+	wp->base.grid->spilllines =
+	    options_get_number(&w->options, "history-spill");
 
 	input_init(wp);
 
@@ -647,9 +667,6 @@ window_pane_destroy(struct window_pane *wp)
 {
 	window_pane_reset_mode(wp);
 
-	if (event_initialized(&wp->changes_timer))
-		evtimer_del(&wp->changes_timer);
-
 	if (wp->fd != -1) {
 		bufferevent_free(wp->event);
 		close(wp->fd);
@@ -668,6 +685,8 @@ window_pane_destroy(struct window_pane *wp)
 
 	RB_REMOVE(window_pane_tree, &all_window_panes, wp);
 
+	if (wp->name_cmd != NULL)
+		xfree(wp->name_cmd);
 	if (wp->cwd != NULL)
 		xfree(wp->cwd);
 	if (wp->shell != NULL)
@@ -771,43 +790,6 @@ window_pane_spawn(struct window_pane *wp, const char *cmd, const char *shell,
 	return (0);
 }
 
-void
-window_pane_timer_start(struct window_pane *wp)
-{
-	struct timeval	tv;
-
-	tv.tv_sec = 0;
-	tv.tv_usec = 1000;
-
-	evtimer_del(&wp->changes_timer);
-	evtimer_set(&wp->changes_timer, window_pane_timer_callback, wp);
-	evtimer_add(&wp->changes_timer, &tv);
-}
-
-void
-window_pane_timer_callback(unused int fd, unused short events, void *data)
-{
-	struct window_pane	*wp = data;
-	struct window		*w = wp->window;
-	u_int			 interval, trigger;
-
-	interval = options_get_number(&w->options, "c0-change-interval");
-	trigger = options_get_number(&w->options, "c0-change-trigger");
-
-	if (wp->changes_redraw++ == interval) {
-		wp->flags |= PANE_REDRAW;
-		wp->changes_redraw = 0;
-
-	}
-
-	if (trigger == 0 || wp->changes < trigger) {
-		wp->flags |= PANE_REDRAW;
-		wp->flags &= ~PANE_DROP;
-	} else
-		window_pane_timer_start(wp);
-	wp->changes = 0;
-}
-
 /* ARGSUSED */
 void
 window_pane_read_callback(unused struct bufferevent *bufev, void *data)
@@ -823,6 +805,7 @@ window_pane_read_callback(unused struct bufferevent *bufev, void *data)
 	}
 
 	input_parse(wp);
+	server_client_dirty_window(wp->window);
 
 	wp->pipe_off = EVBUFFER_LENGTH(wp->event->input);
 
@@ -877,8 +860,8 @@ window_pane_resize(struct window_pane *wp, u_int sx, u_int sy)
 }
 
 /*
- * Enter alternative screen mode. A copy of the visible screen is saved and the
- * history is not updated
+ * Enter alternative screen mode. The visible lines are moved into a saved grid
+ * (leaving the screen empty) and the history is not updated.
  */
 void
 window_pane_alternate_on(struct window_pane *wp, struct grid_cell *gc)
@@ -894,19 +877,17 @@ window_pane_alternate_on(struct window_pane *wp, struct grid_cell *gc)
 	sy = screen_size_y(s);
 
 	wp->saved_grid = grid_create(sx, sy, 0);
-	grid_duplicate_lines(wp->saved_grid, 0, s->grid, screen_hsize(s), sy);
+	grid_transfer_lines(wp->saved_grid, 0, s->grid, screen_hsize(s), sy);
 	wp->saved_cx = s->cx;
 	wp->saved_cy = s->cy;
 	memcpy(&wp->saved_cell, gc, sizeof wp->saved_cell);
 
-	grid_view_clear(s->grid, 0, 0, sx, sy);
-
 	wp->base.grid->flags &= ~GRID_HISTORY;
 
-	wp->flags |= PANE_REDRAW;
+	server_redraw_pane(wp);
 }
 
-/* Exit alternate screen mode and restore the copied grid. */
+/* Exit alternate screen mode and restore the saved grid. */
 void
 window_pane_alternate_off(struct window_pane *wp, struct grid_cell *gc)
 {
@@ -928,7 +909,7 @@ window_pane_alternate_off(struct window_pane *wp, struct grid_cell *gc)
 		screen_resize(s, sx, wp->saved_grid->sy);
 
 	/* Restore the grid, cursor position and cell. */
-	grid_duplicate_lines(s->grid, screen_hsize(s), wp->saved_grid, 0, sy);
+	grid_transfer_lines(s->grid, screen_hsize(s), wp->saved_grid, 0, sy);
 	s->cx = wp->saved_cx;
 	if (s->cx > screen_size_x(s) - 1)
 		s->cx = screen_size_x(s) - 1;
@@ -948,7 +929,7 @@ window_pane_alternate_off(struct window_pane *wp, struct grid_cell *gc)
 	grid_destroy(wp->saved_grid);
 	wp->saved_grid = NULL;
 
-	wp->flags |= PANE_REDRAW;
+	server_redraw_pane(wp);
 }
 
 int
@@ -962,7 +943,7 @@ window_pane_set_mode(struct window_pane *wp, const struct window_mode *mode)
 
 	if ((s = wp->mode->init(wp)) != NULL)
 		wp->screen = s;
-	wp->flags |= PANE_REDRAW;
+	server_redraw_pane(wp);
 	return (0);
 }
 
@@ -976,7 +957,7 @@ window_pane_reset_mode(struct window_pane *wp)
 	wp->mode = NULL;
 
 	wp->screen = &wp->base;
-	wp->flags |= PANE_REDRAW;
+	server_redraw_pane(wp);
 }
 
 void